@@ -33,13 +33,15 @@ seqio_read(char* filename)
 }
 
 static inline void
-seqio_write(char* filename, int gzip)
+seqio_write(char* filename, int gzip, int bgzf)
 {
   seqioOpenOptions openOption = {
     .filename = filename,
   };
   char outname[1024] = { 0 };
-  if (gzip) {
+  if (bgzf) {
+    snprintf(outname, 1024, "%s.out.bgzf.gz", filename);
+  } else if (gzip) {
     snprintf(outname, 1024, "%s.out.gz", filename);
   } else {
     snprintf(outname, 1024, "%s.out", filename);
@@ -48,6 +50,8 @@ seqio_write(char* filename, int gzip)
     .filename = outname,
     .mode = seqOpenModeWrite,
     .isGzipped = gzip,
+    .threads = bgzf ? 4 : 0,
+    .bgzf = bgzf,
   };
   seqioFile* sf = seqioOpen(&openOption);
   seqioFile* sfWrite = seqioOpen(&op);
@@ -82,14 +86,21 @@ main(int argc, char** argv)
 #ifdef WRITE
   printf("Writing %s.out\n", argv[1]);
   start = timer();
-  seqio_write(argv[1], 0);
+  seqio_write(argv[1], 0, 0);
   end = timer();
   printf("Time: %.3f\n", end - start);
 #endif
 #ifdef WRITE_GZ
   printf("Writing %s.out.gz\n", argv[1]);
   start = timer();
-  seqio_write(argv[1], 1);
+  seqio_write(argv[1], 1, 0);
+  end = timer();
+  printf("Time: %.3f\n", end - start);
+#endif
+#ifdef WRITE_BGZF
+  printf("Writing %s.out.bgzf.gz\n", argv[1]);
+  start = timer();
+  seqio_write(argv[1], 1, 1);
   end = timer();
   printf("Time: %.3f\n", end - start);
 #endif
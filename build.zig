@@ -4,6 +4,7 @@ pub fn build(b: *std.Build) void {
     const target = b.standardTargetOptions(.{});
 
     const mode = b.standardOptimizeOption(.{});
+    const libdeflate = b.option(bool, "libdeflate", "Inflate BGZF blocks with the system libdeflate") orelse false;
     const seqio = b.addStaticLibrary(.{
         .name = "seqio",
         .target = target,
@@ -43,11 +44,19 @@ pub fn build(b: *std.Build) void {
         .files = &[_][]const u8{
             "seqio.c",
         },
-        .flags = &[_][]const u8{
+        .flags = if (libdeflate) &[_][]const u8{
+            "-std=c99",
+            "-O3",
+            "-DSEQIO_USE_LIBDEFLATE",
+        } else &[_][]const u8{
             "-std=c99",
             "-O3",
         },
     });
 
+    if (libdeflate) {
+        seqio.linkSystemLibrary("deflate");
+    }
+
     b.installArtifact(seqio);
 }
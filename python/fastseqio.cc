@@ -1,16 +1,22 @@
 #include "pybind11/cast.h"
 #include "pybind11/detail/common.h"
+#include "pybind11/numpy.h"
 #include "pybind11/pybind11.h"
 #include "pybind11/pytypes.h"
 #include "seqio.h"
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <iterator>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <stdio.h>
 #include <string>
+#include <vector>
 
 namespace py = pybind11;
 
@@ -39,7 +45,8 @@ seqioRecordInit(const char* name,
                 const char* sequence,
                 const char* quality)
 {
-  seqioRecord* record = (seqioRecord*)seqioMalloc(sizeof(seqioRecord));
+  // allocated with new like the strings, seqioRecordRelease frees both
+  seqioRecord* record = new seqioRecord();
   record->name = seqioStringRef(name);
   record->comment = seqioStringRef(comment);
   record->sequence = seqioStringRef(sequence);
@@ -47,6 +54,96 @@ seqioRecordInit(const char* name,
   return record;
 }
 
+void
+seqioRecordRelease(seqioRecord* record)
+{
+  delete record->name;
+  delete record->comment;
+  delete record->sequence;
+  delete record->quality;
+  delete record;
+}
+
+static void
+seqioMinimizerCheck(int k, int w)
+{
+  if (k < 1 || k > 32) {
+    throw py::value_error("k must be in [1, 32]");
+  }
+  if (w < 1 || w > seqioMaxMinimizerWindow) {
+    throw py::value_error("w must be in [1, 256]");
+  }
+}
+
+static seqioSyncmerType
+seqioSyncmerCheck(int k, int s, bool closed, int offset)
+{
+  if (k < 1 || k > 32) {
+    throw py::value_error("k must be in [1, 32]");
+  }
+  if (s < 1 || s > k) {
+    throw py::value_error("s must be in [1, k]");
+  }
+  if (!closed && (offset < 0 || offset > k - s)) {
+    throw py::value_error("offset must be in [0, k - s]");
+  }
+  return closed ? seqioSyncmerClosed : seqioSyncmerOpen;
+}
+
+// A sketch writes at most one hit per k-mer of a sequence.
+static size_t
+seqioSketchRoom(size_t length, int k)
+{
+  return length >= (size_t)k ? length - k + 1 : 0;
+}
+
+// Sketch one sequence into uint64 hashes and positions.
+template <typename Sketch>
+static py::tuple
+seqioSketchOne(const std::string& sequence, int k, Sketch sketch)
+{
+  py::ssize_t room = seqioSketchRoom(sequence.length(), k);
+  py::array_t<uint64_t> hashes(room);
+  py::array_t<size_t> positions(room);
+  size_t count = sketch(sequence.data(), sequence.length(),
+                        hashes.mutable_data(), positions.mutable_data());
+  hashes.resize(std::vector<py::ssize_t>{ (py::ssize_t)count });
+  positions.resize(std::vector<py::ssize_t>{ (py::ssize_t)count });
+  return py::make_tuple(hashes, positions);
+}
+
+// Sketch every sequence of a batch without the GIL, the hits of record i
+// are hashes[offsets[i]:offsets[i + 1]].
+template <typename Sketch>
+static py::tuple
+seqioSketchBatch(const seqioBatch* batch, int k, Sketch sketch)
+{
+  size_t room = 0;
+  for (size_t i = 0; i < batch->count; i++) {
+    room += seqioSketchRoom(batch->sequence[i].length, k);
+  }
+  py::array_t<uint64_t> hashes((py::ssize_t)room);
+  py::array_t<size_t> positions((py::ssize_t)room);
+  py::array_t<int64_t> offsets((py::ssize_t)batch->count + 1);
+  uint64_t* hash = hashes.mutable_data();
+  size_t* position = positions.mutable_data();
+  int64_t* offset = offsets.mutable_data();
+  size_t total = 0;
+  {
+    py::gil_scoped_release release;
+    for (size_t i = 0; i < batch->count; i++) {
+      seqioSlice slice = batch->sequence[i];
+      offset[i] = (int64_t)total;
+      total += sketch(batch->data + slice.offset, slice.length, hash + total,
+                      position + total);
+    }
+    offset[batch->count] = (int64_t)total;
+  }
+  hashes.resize(std::vector<py::ssize_t>{ (py::ssize_t)total });
+  positions.resize(std::vector<py::ssize_t>{ (py::ssize_t)total });
+  return py::make_tuple(hashes, positions, offsets);
+}
+
 class seqioRecordImpl {
 
 public:
@@ -177,6 +274,67 @@ public:
     return hpc_sequence;
   }
 
+  // Canonical or forward 2-bit k-mers, A, C, G and T are 0 to 3 and the
+  // last base is in the low bits. k up to 32 gives a uint64 array, up to 64
+  // a (n, 2) uint64 array of [hi, lo]. Windows holding another base are
+  // skipped, withPositions also returns the start of every k-mer.
+  py::object
+  kmerArray(int k, bool canonical, bool withPositions)
+  {
+    if (k < 1 || k > 64) {
+      throw py::value_error("k must be in [1, 64]");
+    }
+    size_t length = sequence.length();
+    py::ssize_t room = length >= (size_t)k ? length - k + 1 : 0;
+    py::array_t<size_t> positions(withPositions ? room : 0);
+    size_t* position = withPositions ? positions.mutable_data() : nullptr;
+    py::array_t<uint64_t> kmers;
+    size_t count;
+    if (k <= 32) {
+      kmers = py::array_t<uint64_t>(room);
+      count = seqioKmers(sequence.data(), length, k, canonical,
+                         kmers.mutable_data(), position);
+      kmers.resize(std::vector<py::ssize_t>{ (py::ssize_t)count });
+    } else {
+      kmers = py::array_t<uint64_t>(std::vector<py::ssize_t>{ room, 2 });
+      count = seqioKmers128(sequence.data(), length, k, canonical,
+                            (seqioKmer128*)kmers.mutable_data(), position);
+      kmers.resize(std::vector<py::ssize_t>{ (py::ssize_t)count, 2 });
+    }
+    if (!withPositions) {
+      return kmers;
+    }
+    positions.resize(std::vector<py::ssize_t>{ (py::ssize_t)count });
+    return py::make_tuple(kmers, positions);
+  }
+
+  // (w, k) minimizers as uint64 hashes and the start of their k-mers.
+  py::tuple
+  minimizers(int k, int w)
+  {
+    seqioMinimizerCheck(k, w);
+    return seqioSketchOne(sequence, k,
+                          [k, w](const char* sequence, size_t length,
+                                 uint64_t* hashes, size_t* positions) {
+                            return seqioMinimizers(sequence, length, k, w,
+                                                   hashes, positions);
+                          });
+  }
+
+  // Open or closed syncmers as uint64 hashes and the start of their k-mers.
+  py::tuple
+  syncmers(int k, int s, bool closed, int offset)
+  {
+    seqioSyncmerType type = seqioSyncmerCheck(k, s, closed, offset);
+    return seqioSketchOne(sequence, k,
+                          [k, s, type, offset](const char* sequence,
+                                               size_t length, uint64_t* hashes,
+                                               size_t* positions) {
+                            return seqioSyncmers(sequence, length, k, s, type,
+                                                 offset, hashes, positions);
+                          });
+  }
+
   seqioRecord*
   as_seqioRecord()
   {
@@ -211,6 +369,460 @@ seqioRecordPickleDeserialize(const py::tuple& tuple)
   return record;
 }
 
+// A, C, G and T in either case to 0 to 3, any other byte to 4.
+static uint8_t seqioBaseIndex[256];
+
+static void
+seqioBaseIndexInit()
+{
+  std::memset(seqioBaseIndex, 4, sizeof(seqioBaseIndex));
+  const char* bases = "ACGT";
+  for (int i = 0; i < 4; i++) {
+    seqioBaseIndex[(uint8_t)bases[i]] = i;
+    seqioBaseIndex[(uint8_t)(bases[i] | 0x20)] = i;
+  }
+}
+
+// Copy n bytes of a field into an array, encoding bases or subtracting a
+// Phred offset on the way. Returns false when a quality is below the offset.
+static bool
+seqioExportBytes(uint8_t* out,
+                 const char* in,
+                 size_t n,
+                 int phredOffset,
+                 bool encode)
+{
+  const uint8_t* src = (const uint8_t*)in;
+  if (encode) {
+    for (size_t i = 0; i < n; i++) {
+      out[i] = seqioBaseIndex[src[i]];
+    }
+    return true;
+  }
+  if (phredOffset == 0) {
+    std::memcpy(out, src, n);
+    return true;
+  }
+  uint8_t offset = (uint8_t)phredOffset;
+  uint8_t low = 0xff;
+  for (size_t i = 0; i < n; i++) {
+    low = std::min(low, src[i]);
+    out[i] = src[i] - offset;
+  }
+  return n == 0 || low >= offset;
+}
+
+static void
+seqioExportCheck(int phredOffset, bool encode)
+{
+  if (phredOffset < 0 || phredOffset > 255) {
+    throw py::value_error("phredOffset must be in [0, 255]");
+  }
+  if (phredOffset && encode) {
+    throw py::value_error("phredOffset and encode can not be used together");
+  }
+}
+
+// Arrow C data interface, the structs are copied from the spec so that the
+// binding does not link Arrow.
+// https://arrow.apache.org/docs/format/CDataInterface.html
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+  const char* format;
+  const char* name;
+  const char* metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+  void (*release)(struct ArrowSchema*);
+  void* private_data;
+};
+
+struct ArrowArray {
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+  void (*release)(struct ArrowArray*);
+  void* private_data;
+};
+
+#endif // ARROW_C_DATA_INTERFACE
+
+// A batch is exported as a struct of large_string columns, quality is only
+// there for FASTQ.
+static const char* seqioArrowFields[] = { "name", "comment", "sequence",
+                                          "quality" };
+
+static int64_t
+seqioArrowFieldCount(const seqioBatch* batch)
+{
+  return batch->type == seqioRecordTypeFastq ? 4 : 3;
+}
+
+static seqioSlice*
+seqioArrowSlices(const seqioBatch* batch, int64_t field)
+{
+  seqioSlice* slices[] = { batch->name, batch->comment, batch->sequence,
+                           batch->quality };
+  return slices[field];
+}
+
+struct seqioArrowSchemaData {
+  std::vector<ArrowSchema*> children;
+};
+
+static void
+seqioArrowSchemaRelease(ArrowSchema* schema)
+{
+  auto data = (seqioArrowSchemaData*)schema->private_data;
+  if (data) {
+    for (auto child : data->children) {
+      if (child->release) {
+        child->release(child);
+      }
+      delete child;
+    }
+    delete data;
+  }
+  schema->release = nullptr;
+}
+
+static void
+seqioArrowSchemaInit(ArrowSchema* schema, const char* format, const char* name)
+{
+  schema->format = format;
+  schema->name = name;
+  schema->metadata = nullptr;
+  schema->flags = 0;
+  schema->n_children = 0;
+  schema->children = nullptr;
+  schema->dictionary = nullptr;
+  schema->release = seqioArrowSchemaRelease;
+  schema->private_data = nullptr;
+}
+
+static void
+seqioArrowExportSchema(const seqioBatch* batch, ArrowSchema* schema)
+{
+  auto data = new seqioArrowSchemaData();
+  for (int64_t i = 0; i < seqioArrowFieldCount(batch); i++) {
+    auto child = new ArrowSchema();
+    seqioArrowSchemaInit(child, "U", seqioArrowFields[i]);
+    data->children.push_back(child);
+  }
+  seqioArrowSchemaInit(schema, "+s", "");
+  schema->n_children = (int64_t)data->children.size();
+  schema->children = data->children.data();
+  schema->private_data = data;
+}
+
+// Owns the buffers of one column, or the children of the struct.
+struct seqioArrowArrayData {
+  std::vector<int64_t> offsets;
+  std::vector<char> values;
+  std::vector<ArrowArray*> children;
+  const void* buffers[3];
+};
+
+static void
+seqioArrowArrayRelease(ArrowArray* array)
+{
+  auto data = (seqioArrowArrayData*)array->private_data;
+  for (auto child : data->children) {
+    if (child->release) {
+      child->release(child);
+    }
+    delete child;
+  }
+  delete data;
+  array->release = nullptr;
+}
+
+static void
+seqioArrowArrayInit(ArrowArray* array, int64_t length, int64_t buffers)
+{
+  auto data = new seqioArrowArrayData();
+  data->buffers[0] = data->buffers[1] = data->buffers[2] = nullptr;
+  array->length = length;
+  array->null_count = 0;
+  array->offset = 0;
+  array->n_buffers = buffers;
+  array->n_children = 0;
+  array->buffers = data->buffers;
+  array->children = nullptr;
+  array->dictionary = nullptr;
+  array->release = seqioArrowArrayRelease;
+  array->private_data = data;
+}
+
+// Fields are not contiguous in the batch arena, so every column gets its
+// own copy of the values.
+static void
+seqioArrowExportColumn(const seqioBatch* batch,
+                       int64_t field,
+                       ArrowArray* array)
+{
+  seqioSlice* slices = seqioArrowSlices(batch, field);
+  seqioArrowArrayInit(array, (int64_t)batch->count, 3);
+  auto data = (seqioArrowArrayData*)array->private_data;
+  size_t total = 0;
+  data->offsets.resize(batch->count + 1);
+  for (size_t i = 0; i < batch->count; i++) {
+    data->offsets[i] = (int64_t)total;
+    total += slices[i].length;
+  }
+  data->offsets[batch->count] = (int64_t)total;
+  // keep the values buffer non null for empty columns
+  data->values.resize(std::max(total, (size_t)1));
+  char* out = data->values.data();
+  for (size_t i = 0; i < batch->count; i++) {
+    std::memcpy(out + data->offsets[i], batch->data + slices[i].offset,
+                slices[i].length);
+  }
+  data->buffers[1] = data->offsets.data();
+  data->buffers[2] = data->values.data();
+}
+
+static void
+seqioArrowExportArray(const seqioBatch* batch, ArrowArray* array)
+{
+  seqioArrowArrayInit(array, (int64_t)batch->count, 1);
+  auto data = (seqioArrowArrayData*)array->private_data;
+  for (int64_t i = 0; i < seqioArrowFieldCount(batch); i++) {
+    auto child = new ArrowArray();
+    seqioArrowExportColumn(batch, i, child);
+    data->children.push_back(child);
+  }
+  array->n_children = (int64_t)data->children.size();
+  array->children = data->children.data();
+}
+
+static void
+seqioArrowSchemaCapsuleFree(PyObject* capsule)
+{
+  auto schema = (ArrowSchema*)PyCapsule_GetPointer(capsule, "arrow_schema");
+  if (schema->release) {
+    schema->release(schema);
+  }
+  delete schema;
+}
+
+static void
+seqioArrowArrayCapsuleFree(PyObject* capsule)
+{
+  auto array = (ArrowArray*)PyCapsule_GetPointer(capsule, "arrow_array");
+  if (array->release) {
+    array->release(array);
+  }
+  delete array;
+}
+
+// PyCapsules of the Arrow PyCapsule interface, consumers move the struct
+// out and leave release unset.
+static py::object
+seqioArrowSchemaCapsule(const seqioBatch* batch)
+{
+  auto schema = new ArrowSchema();
+  seqioArrowExportSchema(batch, schema);
+  return py::reinterpret_steal<py::object>(
+      PyCapsule_New(schema, "arrow_schema", seqioArrowSchemaCapsuleFree));
+}
+
+static py::object
+seqioArrowArrayCapsule(const seqioBatch* batch)
+{
+  auto array = new ArrowArray();
+  {
+    py::gil_scoped_release release;
+    seqioArrowExportArray(batch, array);
+  }
+  return py::reinterpret_steal<py::object>(
+      PyCapsule_New(array, "arrow_array", seqioArrowArrayCapsuleFree));
+}
+
+// Records read in one go, every field is a slice of the batch arena. The
+// arena is exported through the buffer protocol, so Python sees the fields
+// as memoryviews without copying them.
+class seqioBatchImpl {
+public:
+  seqioBatch* batch;
+
+  explicit seqioBatchImpl(size_t records)
+  {
+    this->batch = seqioBatchNew(records, 0);
+    if (this->batch == nullptr) {
+      throw std::bad_alloc();
+    }
+  }
+
+  seqioBatchImpl(const seqioBatchImpl&) = delete;
+  seqioBatchImpl& operator=(const seqioBatchImpl&) = delete;
+
+  ~seqioBatchImpl() { seqioBatchFree(this->batch); }
+
+  size_t
+  size() const
+  {
+    return batch->count;
+  }
+
+  bool
+  isFastq() const
+  {
+    return batch->type == seqioRecordTypeFastq;
+  }
+
+  seqioSlice*
+  slices(const std::string& field) const
+  {
+    if (field == "name") {
+      return batch->name;
+    }
+    if (field == "comment") {
+      return batch->comment;
+    }
+    if (field == "sequence") {
+      return batch->sequence;
+    }
+    if (field == "quality") {
+      return batch->quality;
+    }
+    throw py::value_error("Unknown field: " + field);
+  }
+
+  // One field of every record as a flat uint8 array and int64 offsets,
+  // record i is values[offsets[i]:offsets[i + 1]].
+  py::tuple
+  ragged(const std::string& field, int phredOffset, bool encode) const
+  {
+    seqioExportCheck(phredOffset, encode);
+    seqioSlice* slices = this->slices(field);
+    size_t count = batch->count;
+    py::array_t<int64_t> offsets((py::ssize_t)count + 1);
+    int64_t* offset = offsets.mutable_data();
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+      offset[i] = (int64_t)total;
+      total += slices[i].length;
+    }
+    offset[count] = (int64_t)total;
+    py::array_t<uint8_t> values((py::ssize_t)total);
+    uint8_t* out = values.mutable_data();
+    bool ok = true;
+    {
+      py::gil_scoped_release release;
+      for (size_t i = 0; i < count; i++) {
+        ok &= seqioExportBytes(out + offset[i], batch->data + slices[i].offset,
+                               slices[i].length, phredOffset, encode);
+      }
+    }
+    if (!ok) {
+      throw py::value_error("Quality below the Phred offset");
+    }
+    return py::make_tuple(values, offsets);
+  }
+
+  // One field of every record as a (records, width) uint8 array filled
+  // with pad, and the int64 number of values written to each row. Width 0
+  // is the longest record, longer records are cut at width.
+  py::tuple
+  padded(const std::string& field,
+         size_t width,
+         uint8_t pad,
+         int phredOffset,
+         bool encode) const
+  {
+    seqioExportCheck(phredOffset, encode);
+    seqioSlice* slices = this->slices(field);
+    size_t count = batch->count;
+    if (width == 0) {
+      for (size_t i = 0; i < count; i++) {
+        width = std::max(width, slices[i].length);
+      }
+    }
+    py::array_t<uint8_t> values(
+        std::vector<py::ssize_t>{ (py::ssize_t)count, (py::ssize_t)width });
+    py::array_t<int64_t> lengths((py::ssize_t)count);
+    uint8_t* out = values.mutable_data();
+    int64_t* length = lengths.mutable_data();
+    bool ok = true;
+    {
+      py::gil_scoped_release release;
+      std::memset(out, pad, count * width);
+      for (size_t i = 0; i < count; i++) {
+        size_t n = std::min(width, slices[i].length);
+        ok &= seqioExportBytes(out + i * width, batch->data + slices[i].offset,
+                               n, phredOffset, encode);
+        length[i] = (int64_t)n;
+      }
+    }
+    if (!ok) {
+      throw py::value_error("Quality below the Phred offset");
+    }
+    return py::make_tuple(values, lengths);
+  }
+
+  py::tuple
+  minimizers(int k, int w) const
+  {
+    seqioMinimizerCheck(k, w);
+    return seqioSketchBatch(batch, k,
+                            [k, w](const char* sequence, size_t length,
+                                   uint64_t* hashes, size_t* positions) {
+                              return seqioMinimizers(sequence, length, k, w,
+                                                     hashes, positions);
+                            });
+  }
+
+  py::tuple
+  syncmers(int k, int s, bool closed, int offset) const
+  {
+    seqioSyncmerType type = seqioSyncmerCheck(k, s, closed, offset);
+    return seqioSketchBatch(batch, k,
+                            [k, s, type, offset](const char* sequence,
+                                                 size_t length,
+                                                 uint64_t* hashes,
+                                                 size_t* positions) {
+                              return seqioSyncmers(sequence, length, k, s,
+                                                   type, offset, hashes,
+                                                   positions);
+                            });
+  }
+};
+
+// The (offset, length) pairs of one field of a batch as a read only
+// uint64 buffer of shape (records, 2), it keeps the batch alive.
+class seqioSliceImpl {
+public:
+  std::shared_ptr<seqioBatchImpl> owner;
+  seqioSlice* slices;
+  size_t count;
+};
+
+// Holds the lock of a file for one call with the GIL released. Waiting for
+// the lock without the GIL keeps a thread that parses a batch, and needs
+// the GIL back to return, from deadlocking with one waiting for the file.
+class seqioFileGuard {
+public:
+  explicit seqioFileGuard(std::mutex& lock) : guard(lock) {}
+
+private:
+  py::gil_scoped_release release;
+  std::lock_guard<std::mutex> guard;
+};
+
 class seqioFileImpl {
 public:
   std::string filename;
@@ -241,7 +853,12 @@ public:
     this->record = nullptr;
   }
 
-  ~seqioFileImpl() { this->close(); }
+  ~seqioFileImpl()
+  {
+    // nothing else can hold a reference by now, and the GIL is left alone
+    std::lock_guard<std::mutex> guard(lock);
+    closeFile();
+  }
 
   void
   set_write_line_width(size_t lineWidth)
@@ -264,28 +881,31 @@ public:
   void
   close()
   {
-    if (this->file) {
-      seqioClose(file);
-      file = nullptr;
-      this->record = nullptr;
-    }
+    seqioFileGuard guard(lock);
+    closeFile();
   }
 
   void
   fflush()
   {
+    seqioFileGuard guard(lock);
+    ensureOpen();
     seqioFlush(file);
   }
 
   void
   reset()
   {
+    seqioFileGuard guard(lock);
+    ensureOpen();
     seqioReset(file);
   }
 
   std::shared_ptr<seqioRecordImpl>
   readOne()
   {
+    seqioFileGuard guard(lock);
+    ensureOpen();
     auto record = seqioRead(file, this->record);
     if (record == NULL) {
       return NULL;
@@ -299,6 +919,8 @@ public:
   std::shared_ptr<seqioRecordImpl>
   readFasta()
   {
+    seqioFileGuard guard(lock);
+    ensureOpen();
     if (file->pravite.type != seqioRecordTypeFasta) {
       fprintf(stderr, "Error: file is not fasta file\n");
       return NULL;
@@ -315,6 +937,8 @@ public:
   std::shared_ptr<seqioRecordImpl>
   readFastq()
   {
+    seqioFileGuard guard(lock);
+    ensureOpen();
     if (file->pravite.type != seqioRecordTypeFastq) {
       fprintf(stderr, "Error: file is not fastq file\n");
       return NULL;
@@ -329,43 +953,108 @@ public:
         this->record->quality);
   }
 
+  // Parse up to maxRecords records, or until the arena holds maxBytes,
+  // without holding the GIL. Returns None at the end of the file.
+  std::shared_ptr<seqioBatchImpl>
+  readBatch(size_t maxRecords, size_t maxBytes)
+  {
+    auto batch = std::make_shared<seqioBatchImpl>(maxRecords);
+    size_t count;
+    {
+      seqioFileGuard guard(lock);
+      ensureOpen();
+      count = seqioReadBatch(file, batch->batch, maxRecords, maxBytes);
+    }
+    if (count == 0) {
+      return nullptr;
+    }
+    return batch;
+  }
+
   void
   writeFasta(std::shared_ptr<seqioRecordImpl> record)
   {
+    seqioFileGuard guard(lock);
+    ensureOpen();
     seqioRecord* _record = record->as_seqioRecord();
     seqioWriteFasta(file, _record, NULL);
-    delete _record;
+    seqioRecordRelease(_record);
   }
 
   void
   writeFastq(std::shared_ptr<seqioRecordImpl> record)
   {
+    seqioFileGuard guard(lock);
+    ensureOpen();
     seqioRecord* _record = record->as_seqioRecord();
     seqioWriteFastq(file, _record, NULL);
-    delete _record;
+    seqioRecordRelease(_record);
   }
 
   size_t
   fileSize()
   {
+    seqioFileGuard guard(lock);
+    ensureOpen();
     return this->file->fileStats.fileSize;
   }
 
   size_t
   fileOffset()
   {
+    seqioFileGuard guard(lock);
+    ensureOpen();
     return this->file->fileStats.fileOffset;
   }
 
+  size_t
+  uncompressedSize()
+  {
+    seqioFileGuard guard(lock);
+    ensureOpen();
+    return seqioUncompressedSize(this->file);
+  }
+
+  // False when nothing has been read yet and the file holds no record.
+  bool
+  isFastq()
+  {
+    seqioFileGuard guard(lock);
+    ensureOpen();
+    return seqioGuessType(this->file) == seqioRecordTypeFastq;
+  }
+
 private:
+  // every use of file holds this, see seqioFileGuard
+  std::mutex lock;
   seqioFile* file;
   seqioOpenOptions openOptions;
   seqioWriteOptions writeOptions;
   seqioRecord* record;
+
+  void
+  ensureOpen()
+  {
+    if (this->file == nullptr) {
+      throw py::value_error("I/O operation on closed file");
+    }
+  }
+
+  void
+  closeFile()
+  {
+    if (this->file) {
+      seqioClose(file);
+      file = nullptr;
+      this->record = nullptr;
+    }
+  }
 };
 
 PYBIND11_MODULE(_fastseqio, m)
 {
+  seqioBaseIndexInit();
+
   py::enum_<seqOpenMode>(m, "seqOpenMode")
       .value("READ", seqOpenMode::seqOpenModeRead)
       .value("WRITE", seqOpenMode::seqOpenModeWrite)
@@ -398,6 +1087,12 @@ PYBIND11_MODULE(_fastseqio, m)
       .def("reverse", &seqioRecordImpl::reverse)
       .def("subseq", &seqioRecordImpl::subseq)
       .def("hpc", &seqioRecordImpl::hpc)
+      .def("kmerArray", &seqioRecordImpl::kmerArray, py::arg("k"),
+           py::arg("canonical") = true, py::arg("withPositions") = false)
+      .def("minimizers", &seqioRecordImpl::minimizers, py::arg("k"),
+           py::arg("w"))
+      .def("syncmers", &seqioRecordImpl::syncmers, py::arg("k"), py::arg("s"),
+           py::arg("closed") = true, py::arg("offset") = 0)
       .def(py::pickle(
           [](const seqioRecordImpl& record) {
             return seqioRecordPickleSerialize(record);
@@ -406,9 +1101,61 @@ PYBIND11_MODULE(_fastseqio, m)
             return seqioRecordPickleDeserialize(tuple);
           }));
 
+  py::class_<seqioBatchImpl, std::shared_ptr<seqioBatchImpl> >(
+      m, "seqioBatch", py::buffer_protocol())
+      .def_buffer([](seqioBatchImpl& self) -> py::buffer_info {
+        seqioBatch* batch = self.batch;
+        return py::buffer_info(batch->data, 1,
+                               py::format_descriptor<uint8_t>::format(), 1,
+                               { (py::ssize_t)batch->size }, { 1 }, true);
+      })
+      .def("__len__", &seqioBatchImpl::size)
+      .def("isFastq", &seqioBatchImpl::isFastq)
+      .def("__arrow_c_schema__",
+           [](seqioBatchImpl& self) {
+             return seqioArrowSchemaCapsule(self.batch);
+           })
+      // the columns are always large_string, requested_schema is ignored
+      .def(
+          "__arrow_c_array__",
+          [](seqioBatchImpl& self, py::object) {
+            return py::make_tuple(seqioArrowSchemaCapsule(self.batch),
+                                  seqioArrowArrayCapsule(self.batch));
+          },
+          py::arg("requested_schema") = py::none())
+      .def("minimizers", &seqioBatchImpl::minimizers, py::arg("k"),
+           py::arg("w"))
+      .def("syncmers", &seqioBatchImpl::syncmers, py::arg("k"), py::arg("s"),
+           py::arg("closed") = true, py::arg("offset") = 0)
+      .def("ragged", &seqioBatchImpl::ragged, py::arg("field"),
+           py::arg("phredOffset") = 0, py::arg("encode") = false)
+      .def("padded", &seqioBatchImpl::padded, py::arg("field"),
+           py::arg("width") = 0, py::arg("pad") = 0, py::arg("phredOffset") = 0,
+           py::arg("encode") = false)
+      .def("slices",
+           [](std::shared_ptr<seqioBatchImpl> self, const std::string& field) {
+             seqioSliceImpl view;
+             view.slices = self->slices(field);
+             view.count = self->size();
+             view.owner = self;
+             return view;
+           });
+
+  py::class_<seqioSliceImpl>(m, "seqioSlices", py::buffer_protocol())
+      .def_buffer([](seqioSliceImpl& self) -> py::buffer_info {
+        return py::buffer_info(
+            self.slices, sizeof(size_t), py::format_descriptor<size_t>::format(),
+            2, { (py::ssize_t)self.count, (py::ssize_t)2 },
+            { (py::ssize_t)sizeof(seqioSlice), (py::ssize_t)sizeof(size_t) },
+            true);
+      })
+      .def("__len__", [](const seqioSliceImpl& self) { return self.count; });
+
   py::class_<seqioFileImpl, std::shared_ptr<seqioFileImpl> >(m, "seqioFile")
       .def(py::init<std::string, seqOpenMode, bool>())
       .def("readOne", &seqioFileImpl::readOne)
+      .def("readBatch", &seqioFileImpl::readBatch, py::arg("maxRecords"),
+           py::arg("maxBytes") = 0)
       .def("readFasta", &seqioFileImpl::readFasta)
       .def("readFastq", &seqioFileImpl::readFastq)
       .def("writeFasta", &seqioFileImpl::writeFasta)
@@ -421,5 +1168,7 @@ PYBIND11_MODULE(_fastseqio, m)
            &seqioFileImpl::set_write_include_comment)
       .def("set_write_base_case", &seqioFileImpl::set_write_base_case)
       .def("fileSize", &seqioFileImpl::fileSize)
-      .def("fileOffset", &seqioFileImpl::fileOffset);
+      .def("fileOffset", &seqioFileImpl::fileOffset)
+      .def("uncompressedSize", &seqioFileImpl::uncompressedSize)
+      .def("isFastq", &seqioFileImpl::isFastq);
 }
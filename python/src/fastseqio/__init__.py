@@ -1,3 +1,3 @@
-from .fastseqio import seqioFile, Record
+from .fastseqio import seqioFile, Record, RecordBatch
 
-__all__ = ["seqioFile", "Record"]
+__all__ = ["seqioFile", "Record", "RecordBatch"]
@@ -3,11 +3,16 @@ from _fastseqio import (
     seqOpenMode as _seqOpenMode,
     seqioRecord as _seqioRecord,
     seqioBaseCase as _seqioBaseCase,
+    seqioBatch as _seqioBatch,
 )
 
-from typing import Optional, Literal
+from typing import TYPE_CHECKING, Dict, Iterator, Optional, Literal, Tuple
 
-__all__ = ["Record", "seqioFile"]
+if TYPE_CHECKING:
+    import numpy
+    import pyarrow
+
+__all__ = ["Record", "RecordBatch", "seqioFile"]
 
 
 class seqioOpenMode:
@@ -23,10 +28,11 @@ class seqioBaseCase:
 
 class RecordKmerIterator:
     def __init__(self, record: "Record", k: int):
-        self.__record = record
+        # one copy of the sequence, sliced in Python for every k-mer
+        self.__sequence = record.sequence
         self.__k = k
         self.__index = 0
-        self.__len = len(record)
+        self.__len = len(self.__sequence)
 
     def __iter__(self):
         return self
@@ -34,7 +40,7 @@ class RecordKmerIterator:
     def __next__(self):
         if self.__index >= self.__len - self.__k + 1:
             raise StopIteration
-        kmer = self.__record.subseq(self.__index, self.__k)
+        kmer = self.__sequence[self.__index : self.__index + self.__k]
         self.__index += 1
         return kmer
 
@@ -285,6 +291,258 @@ class Record:
         for kmer in RecordKmerIterator(self, k):
             yield kmer
 
+    def kmer_array(self, k: int, canonical: bool = True, positions: bool = False):
+        """
+        Encode every k-mer of the sequence in C++ as a NumPy array.
+
+        Bases A, C, G and T, in either case, are 0 to 3 at 2 bits each with
+        the last base in the low bits. Windows with any other base are
+        skipped.
+
+        Args:
+            k (int): The k-mer length, from 1 to 64.
+            canonical (bool): Keep the smaller of the k-mer and its reverse
+                complement.
+            positions (bool): Also return the start of every k-mer.
+
+        Returns:
+            numpy.ndarray: uint64 k-mers for k up to 32, or a (n, 2) uint64
+            array of [high, low] words for k up to 64. With positions, a
+            tuple of the k-mers and their uint64 starts.
+
+        Examples:
+            >>> record = Record("id", "ACGTNACG")
+            >>> record.kmer_array(3, canonical=False).tolist()
+            [6, 27, 6]
+            >>> record.kmer_array(3, positions=True)[1].tolist()
+            [0, 1, 5]
+        """
+        return self.__record.kmerArray(k, canonical, positions)
+
+    def minimizers(self, k: int, w: int):
+        """
+        The (w, k) minimizers of the sequence: the smallest hash of the
+        canonical k-mers of every w consecutive k-mers, each reported once.
+
+        Hashes are an invertible 64-bit hash of the 2-bit canonical k-mer.
+        Windows with a base other than A, C, G or T are skipped.
+
+        Args:
+            k (int): The k-mer length, from 1 to 32.
+            w (int): The window in k-mers, from 1 to 256.
+
+        Returns:
+            (hashes, positions): uint64 NumPy arrays, positions are the
+            starts of the minimizer k-mers.
+        """
+        return self.__record.minimizers(k, w)
+
+    def syncmers(self, k: int, s: int, closed: bool = True, offset: int = 0):
+        """
+        The syncmers of the sequence, the canonical k-mers whose smallest
+        s-mer is the first or the last one (closed) or at offset (open).
+
+        Args:
+            k (int): The k-mer length, from 1 to 32.
+            s (int): The s-mer length, from 1 to k.
+            closed (bool): Closed syncmers, otherwise open ones.
+            offset (int): Position of the smallest s-mer of open syncmers,
+                from 0 to k - s.
+
+        Returns:
+            (hashes, positions): uint64 NumPy arrays of the k-mer hashes,
+            the same hash as `minimizers`, and their starts.
+        """
+        return self.__record.syncmers(k, s, closed, offset)
+
+
+class BatchField:
+    """
+    One field of every record in a batch. Items are read only memoryviews
+    into the batch buffer, they are not copied and keep the batch alive.
+    """
+
+    def __init__(self, data: memoryview, slices: memoryview):
+        self.__data = data
+        self.__slices = slices
+
+    def __len__(self):
+        return self.__slices.shape[0]
+
+    def __getitem__(self, index: int) -> memoryview:
+        # 2-d memoryviews take (row, column), not a row
+        offset = self.__slices[index, 0]
+        return self.__data[offset : offset + self.__slices[index, 1]]
+
+    def __iter__(self) -> Iterator[memoryview]:
+        data, slices = self.__data, self.__slices
+        for i in range(slices.shape[0]):
+            offset = slices[i, 0]
+            yield data[offset : offset + slices[i, 1]]
+
+    @property
+    def slices(self) -> memoryview:
+        """
+        The (offset, length) of every item in the batch buffer, a read only
+        uint64 memoryview of shape (records, 2).
+        """
+        return self.__slices
+
+
+class RecordBatch:
+    """
+    Records parsed together by `seqioFile.read_batch`. All fields live in one
+    buffer, `data`, and `names`, `comments`, `sequences` and `qualities` hand
+    out memoryviews into it. Use `bytes(view)` or `str(view, "ascii")` where a
+    copy is wanted.
+    """
+
+    def __init__(self, batch: _seqioBatch):
+        self.__batch = batch
+        self.__data = memoryview(batch)
+        self.__fields: Dict[str, BatchField] = {}
+
+    def __len__(self):
+        return len(self.__batch)
+
+    def __field(self, field: str) -> BatchField:
+        if field not in self.__fields:
+            slices = memoryview(self.__batch.slices(field))
+            self.__fields[field] = BatchField(self.__data, slices)
+        return self.__fields[field]
+
+    @property
+    def is_fastq(self) -> bool:
+        return self.__batch.isFastq()
+
+    @property
+    def data(self) -> memoryview:
+        return self.__data
+
+    @property
+    def names(self) -> BatchField:
+        return self.__field("name")
+
+    @property
+    def comments(self) -> BatchField:
+        return self.__field("comment")
+
+    @property
+    def sequences(self) -> BatchField:
+        return self.__field("sequence")
+
+    @property
+    def qualities(self) -> BatchField:
+        return self.__field("quality")
+
+    def ragged(
+        self,
+        field: str = "sequence",
+        phred_offset: int = 0,
+        encode: bool = False,
+    ) -> Tuple["numpy.ndarray", "numpy.ndarray"]:
+        """
+        Export one field of every record as NumPy arrays in one call.
+
+        Args:
+            field: "name", "comment", "sequence" or "quality".
+            phred_offset: Subtracted from every byte, 33 turns FASTQ
+                qualities into Phred scores.
+            encode: Map A, C, G and T in either case to 0 to 3 and any other
+                base to 4.
+
+        Returns:
+            (values, offsets): uint8 values of all records back to back and
+            int64 offsets, record i is values[offsets[i]:offsets[i + 1]].
+
+        Examples:
+            >>> batch = seqioFile('test-data/test4.fq').read_batch(2)
+            >>> values, offsets = batch.ragged("quality", phred_offset=33)
+        """
+        return self.__batch.ragged(field, phred_offset, encode)
+
+    def padded(
+        self,
+        field: str = "sequence",
+        width: int = 0,
+        pad: int = 0,
+        phred_offset: int = 0,
+        encode: bool = False,
+    ) -> Tuple["numpy.ndarray", "numpy.ndarray"]:
+        """
+        Export one field of every record as a fixed width NumPy matrix.
+
+        Args:
+            field: "name", "comment", "sequence" or "quality".
+            width: Columns of the matrix, 0 uses the longest record. Longer
+                records are cut at width.
+            pad: Value of the cells past the end of a record.
+            phred_offset: Same as in `ragged`.
+            encode: Same as in `ragged`.
+
+        Returns:
+            (values, lengths): a uint8 (records, width) matrix and the int64
+            number of cells filled in each row.
+
+        Examples:
+            >>> batch = seqioFile('test-data/test4.fq').read_batch(2)
+            >>> bases, lengths = batch.padded(encode=True, pad=4)
+        """
+        return self.__batch.padded(field, width, pad, phred_offset, encode)
+
+    def minimizers(
+        self, k: int, w: int
+    ) -> Tuple["numpy.ndarray", "numpy.ndarray", "numpy.ndarray"]:
+        """
+        `Record.minimizers` of every sequence in the batch, computed without
+        the GIL.
+
+        Returns:
+            (hashes, positions, offsets): the hits of record i are
+            hashes[offsets[i]:offsets[i + 1]] and the same slice of
+            positions.
+        """
+        return self.__batch.minimizers(k, w)
+
+    def syncmers(
+        self, k: int, s: int, closed: bool = True, offset: int = 0
+    ) -> Tuple["numpy.ndarray", "numpy.ndarray", "numpy.ndarray"]:
+        """
+        `Record.syncmers` of every sequence in the batch, laid out as in
+        `minimizers`.
+        """
+        return self.__batch.syncmers(k, s, closed, offset)
+
+    def __arrow_c_schema__(self):
+        return self.__batch.__arrow_c_schema__()
+
+    def __arrow_c_array__(self, requested_schema=None):
+        return self.__batch.__arrow_c_array__(requested_schema)
+
+    def to_arrow(self) -> "pyarrow.RecordBatch":
+        """
+        Convert to a pyarrow RecordBatch with large_string columns name,
+        comment, sequence and, for FASTQ, quality. The batch also implements
+        the Arrow PyCapsule interface, so polars or duckdb can take it
+        directly without pyarrow.
+        """
+        import pyarrow
+
+        return pyarrow.record_batch(self)
+
+    def __iter__(self) -> Iterator[Record]:
+        names = self.names
+        comments = self.comments
+        sequences = self.sequences
+        qualities = self.qualities
+        for i in range(len(self)):
+            yield Record(
+                str(names[i], "utf-8"),
+                str(sequences[i], "ascii"),
+                str(qualities[i], "ascii") if self.is_fastq else None,
+                str(comments[i], "utf-8") or None,
+            )
+
 
 class seqioFile:
     def __init__(
@@ -318,6 +576,7 @@ class seqioFile:
             self.__mode = seqioOpenMode.WRITE
         else:
             self.__mode = seqioOpenMode.READ
+        self.__path = path
         if path == "-":
             self.__file = _seqioFile("", self.__mode, compressed)
             return
@@ -447,6 +706,71 @@ class seqioFile:
             return None
         return Record._fromRecord(record)
 
+    def read_batch(
+        self, n: int = 4096, max_bytes: int = 0
+    ) -> Optional[RecordBatch]:
+        """
+        Read up to n records, or until they take max_bytes, into one buffer.
+        Parsing runs without the GIL, so other Python threads keep going.
+
+        Returns:
+            RecordBatch: The records read.
+            None: At the end of the file.
+
+        Examples:
+            >>> seqio = seqioFile('test-data/test4.fq')
+            >>> batch = seqio.read_batch(2)
+            >>> len(batch)
+            2
+            >>> bytes(batch.names[0])
+            b'read1'
+        """
+        if not self.readable:
+            raise ValueError("File not opened in read mode")
+        assert n > 0, "n must be greater than 0"
+        file = self._get_file()
+        batch = file.readBatch(n, max_bytes)
+        if batch is None:
+            return None
+        return RecordBatch(batch)
+
+    def batches(self, n: int = 4096, max_bytes: int = 0) -> Iterator[RecordBatch]:
+        """
+        Iterate over the rest of the file n records at a time.
+        """
+        while True:
+            batch = self.read_batch(n, max_bytes)
+            if batch is None:
+                break
+            yield batch
+
+    def to_arrow(self, n: int = 65536) -> "pyarrow.Table":
+        """
+        Read the rest of the file into a pyarrow Table, n records per
+        RecordBatch. Use `batches` and `RecordBatch.to_arrow` to stream
+        instead.
+        """
+        import pyarrow
+
+        batches = [batch.to_arrow() for batch in self.batches(n)]
+        if not batches:
+            fields = ["name", "comment", "sequence"]
+            if self.__is_fastq():
+                fields.append("quality")
+            return pyarrow.table(
+                {field: pyarrow.array([], pyarrow.large_string()) for field in fields}
+            )
+        return pyarrow.Table.from_batches(batches)
+
+    def __is_fastq(self) -> bool:
+        if self._get_file().isFastq():
+            return True
+        # a file without records has nothing to guess from but its name
+        path = self.__path.lower()
+        if path.endswith(".gz"):
+            path = path[:-3]
+        return path.endswith((".fq", ".fastq"))
+
     def writeOne(
         self,
         name: str,
@@ -544,6 +868,16 @@ class seqioFile:
         file = self._get_file()
         return file.fileOffset()
 
+    @property
+    def uncompressed_size(self) -> int:
+        """
+        The size of the decompressed content. `size` and `offset` count
+        compressed bytes for gzipped files, this inflates the whole file once
+        on first access.
+        """
+        file = self._get_file()
+        return file.uncompressedSize()
+
     def __iter__(self):
         file = self._get_file()
         while True:
@@ -1,5 +1,7 @@
 import os
 
+import pytest
+
 from fastseqio import seqioFile, Record
 
 
@@ -31,6 +33,74 @@ def test_read():
     assert len(records) == 3
 
 
+def test_read_batch():
+    file = seqioFile("test-data/test2.fa")
+
+    batch = file.read_batch(2)
+    assert batch is not None
+    assert len(batch) == 2
+    assert not batch.is_fastq
+    assert [bytes(name) for name in batch.names] == [b"a", b"b"]
+    assert batch.names.slices.shape == (2, 2)
+    assert batch.names is batch.names
+    assert bytes(batch.sequences[-1]) == bytes(batch.sequences[1])
+
+    batch = file.read_batch(2)
+    assert len(batch) == 1
+    assert bytes(batch.names[0]) == b"c"
+    assert file.read_batch(2) is None
+
+    file.reset()
+    records = [record for batch in file.batches(2) for record in batch]
+    assert [record.name for record in records] == ["a", "b", "c"]
+
+
+def test_batch_numpy():
+    np = pytest.importorskip("numpy")
+    batch = seqioFile("test-data/test4.fq").read_batch(2)
+
+    values, offsets = batch.ragged("sequence")
+    assert offsets.dtype == np.int64 and values.dtype == np.uint8
+    assert bytes(values[offsets[0] : offsets[1]]) == b"CCCTTCTTGTCTTCAGCGTTTCTCC"
+
+    values, offsets = batch.ragged("quality", phred_offset=33)
+    assert values[0] == ord(";") - 33
+
+    bases, lengths = batch.padded(encode=True, width=4, pad=9)
+    assert bases.shape == (2, 4)
+    assert bases[0].tolist() == [1, 1, 1, 3]
+    assert lengths.tolist() == [4, 4]
+
+    bases, lengths = batch.padded("name", pad=9)
+    assert bases.shape == (2, 5)
+    assert bytes(bases[0]) == b"read1"
+
+    with pytest.raises(ValueError):
+        batch.ragged("quality", phred_offset=33, encode=True)
+    with pytest.raises(ValueError):
+        batch.ragged("quality", phred_offset=60)
+
+
+def test_to_arrow(tmp_path):
+    pa = pytest.importorskip("pyarrow")
+
+    table = seqioFile("test-data/test4.fq").to_arrow(2)
+    assert table.num_rows == 3
+    assert table.schema.field("sequence").type == pa.large_string()
+    assert table.column("name").to_pylist()[0] == "read1"
+    assert table.column("quality").to_pylist()[0] == ";;3;;;;;;;;;;;;7;;;;;;;88"
+
+    batch = seqioFile("test-data/test2.fa").read_batch(3).to_arrow()
+    assert batch.schema.names == ["name", "comment", "sequence"]
+    assert batch.column("name").to_pylist() == ["a", "b", "c"]
+
+    empty = tmp_path / "empty.fq"
+    empty.write_text("")
+    table = seqioFile(str(empty)).to_arrow()
+    assert table.num_rows == 0
+    assert table.schema.names == ["name", "comment", "sequence", "quality"]
+
+
 def test_write():
 
     with seqioFile("out.fa", "w") as file:
@@ -109,6 +179,46 @@ def test_kmers():
     assert kmers == ["ACGG", "CGGG", "GGGG"]
 
 
+def test_kmer_array():
+    pytest.importorskip("numpy")
+    record = Record("test", "ACGTNacg")
+
+    assert record.kmer_array(3, canonical=False).tolist() == [6, 27, 6]
+    # CGT is the reverse complement of ACG
+    assert record.kmer_array(3).tolist() == [6, 6, 6]
+    kmers, positions = record.kmer_array(3, positions=True)
+    assert positions.tolist() == [0, 1, 5]
+
+    assert record.kmer_array(4, canonical=False).tolist() == [27]
+    assert record.kmer_array(40).shape == (0, 2)
+    with pytest.raises(ValueError):
+        record.kmer_array(65)
+
+
+def test_sketches():
+    pytest.importorskip("numpy")
+    record = Record("test", "ACGTTGCATGCANNACGTTGCATGCA")
+
+    hashes, positions = record.minimizers(5, 3)
+    assert len(hashes) == len(positions) > 0
+    # the two runs on either side of the Ns are the same sequence
+    half = len(hashes) // 2
+    assert hashes[:half].tolist() == hashes[half:].tolist()
+    assert (positions[half:] - positions[:half]).tolist() == [14] * half
+
+    closed, _ = record.syncmers(7, 3)
+    opened, _ = record.syncmers(7, 3, closed=False, offset=0)
+    assert set(opened.tolist()) <= set(closed.tolist())
+    with pytest.raises(ValueError):
+        record.syncmers(7, 3, closed=False, offset=5)
+
+    batch = seqioFile("test-data/test4.fq").read_batch(3)
+    hashes, positions, offsets = batch.minimizers(11, 5)
+    assert offsets.tolist()[-1] == len(hashes) == len(positions)
+    first = Record("x", str(batch.sequences[0], "ascii")).minimizers(11, 5)[0]
+    assert hashes[offsets[0] : offsets[1]].tolist() == first.tolist()
+
+
 def test_pickle():
     import pickle
 
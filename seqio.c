@@ -1,9 +1,44 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "seqio.h"
 #include <assert.h>
+#include <ctype.h>
 #include <stdio.h>
 #include <string.h>
 #include <zlib.h>
 
+#ifdef SEQIO_USE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SEQIO_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#elif defined(__GNUC__)
+#define SEQIO_AVX2
+#include <immintrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SEQIO_NEON
+#include <arm_neon.h>
+#endif
+
 seqioOpenOptions __defaultStdinOptions = {
   .filename = NULL,
   .isGzipped = false,
@@ -28,6 +63,83 @@ static char* openModeStrGzip[] = {
 
 static seqioWriteOptions defaultWriteOptions = defaultSeqioWriteOptions;
 
+// Thin wrappers so the threaded readers and writers build on both pthreads
+// and Win32.
+#ifdef _WIN32
+typedef HANDLE seqioThread;
+typedef SRWLOCK seqioMutex;
+typedef CONDITION_VARIABLE seqioCond;
+
+typedef struct {
+  void* (*func)(void*);
+  void* arg;
+} threadStart;
+
+static DWORD WINAPI
+threadTrampoline(LPVOID param)
+{
+  threadStart start = *(threadStart*)param;
+  seqioFree(param);
+  start.func(start.arg);
+  return 0;
+}
+
+static inline bool
+threadCreate(seqioThread* thread, void* (*func)(void*), void* arg)
+{
+  threadStart* start = (threadStart*)seqioMalloc(sizeof(threadStart));
+  if (start == NULL) {
+    return false;
+  }
+  start->func = func;
+  start->arg = arg;
+  *thread = CreateThread(NULL, 0, threadTrampoline, start, 0, NULL);
+  if (*thread == NULL) {
+    seqioFree(start);
+    return false;
+  }
+  return true;
+}
+
+static inline void
+threadJoin(seqioThread thread)
+{
+  WaitForSingleObject(thread, INFINITE);
+  CloseHandle(thread);
+}
+
+#define mutexInit(m) InitializeSRWLock(m)
+#define mutexDestroy(m) ((void)(m))
+#define mutexLock(m) AcquireSRWLockExclusive(m)
+#define mutexUnlock(m) ReleaseSRWLockExclusive(m)
+#define condInit(c) InitializeConditionVariable(c)
+#define condDestroy(c) ((void)(c))
+#define condWait(c, m) SleepConditionVariableSRW(c, m, INFINITE, 0)
+#define condSignal(c) WakeConditionVariable(c)
+#define condBroadcast(c) WakeAllConditionVariable(c)
+#else
+typedef pthread_t seqioThread;
+typedef pthread_mutex_t seqioMutex;
+typedef pthread_cond_t seqioCond;
+
+static inline bool
+threadCreate(seqioThread* thread, void* (*func)(void*), void* arg)
+{
+  return pthread_create(thread, NULL, func, arg) == 0;
+}
+
+#define threadJoin(t) pthread_join(t, NULL)
+#define mutexInit(m) pthread_mutex_init(m, NULL)
+#define mutexDestroy(m) pthread_mutex_destroy(m)
+#define mutexLock(m) pthread_mutex_lock(m)
+#define mutexUnlock(m) pthread_mutex_unlock(m)
+#define condInit(c) pthread_cond_init(c, NULL)
+#define condDestroy(c) pthread_cond_destroy(c)
+#define condWait(c, m) pthread_cond_wait(c, m)
+#define condSignal(c) pthread_cond_signal(c)
+#define condBroadcast(c) pthread_cond_broadcast(c)
+#endif
+
 static inline char*
 getOpenModeStr(seqioOpenOptions* options)
 {
@@ -38,6 +150,33 @@ getOpenModeStr(seqioOpenOptions* options)
   }
 }
 
+static inline int
+zlibLevel(seqioOpenOptions* options)
+{
+  // the zero value of the options keeps zlib's default
+  if (options->compressionLevel <= 0 || options->compressionLevel > 9) {
+    return Z_DEFAULT_COMPRESSION;
+  }
+  return options->compressionLevel;
+}
+
+static inline int
+zlibStrategy(seqioOpenOptions* options)
+{
+  switch (options->compressionStrategy) {
+  case seqioStrategyFiltered:
+    return Z_FILTERED;
+  case seqioStrategyHuffmanOnly:
+    return Z_HUFFMAN_ONLY;
+  case seqioStrategyRle:
+    return Z_RLE;
+  case seqioStrategyFixed:
+    return Z_FIXED;
+  default:
+    return Z_DEFAULT_STRATEGY;
+  }
+}
+
 static inline void
 ensureWriteable(seqioFile* sf)
 {
@@ -79,962 +218,5857 @@ backwardBufferOne(seqioFile* sf)
   sf->buffer.left += 1;
 }
 
-static inline size_t
-readDataToBuffer(seqioFile* sf)
+// Codec backends inflate or deflate one whole gzip member whose sizes are
+// known up front, as with BGZF blocks. zlib is the default, build with
+// SEQIO_USE_LIBDEFLATE to use libdeflate instead.
+typedef struct {
+  const char* name;
+  void* (*createInflater)(void);
+  void (*destroyInflater)(void* state);
+  bool (*inflate)(void* state,
+                  const unsigned char* in,
+                  size_t inSize,
+                  unsigned char* out,
+                  size_t outSize);
+  // level and strategy follow zlib, -1 picks the default level
+  void* (*createDeflater)(int level, int strategy);
+  void (*destroyDeflater)(void* state);
+  // returns the compressed size, 0 if it does not fit into outSize
+  size_t (*deflate)(void* state,
+                    const unsigned char* in,
+                    size_t inSize,
+                    unsigned char* out,
+                    size_t outSize);
+  uint32_t (*crc32)(uint32_t crc, const unsigned char* data, size_t size);
+} codecBackend;
+
+#ifdef SEQIO_USE_LIBDEFLATE
+static void*
+libdeflateCreateInflater(void)
 {
-  ensureReadable(sf);
-  if (sf->buffer.left) {
-    return sf->buffer.left;
+  return libdeflate_alloc_decompressor();
+}
+
+static void
+libdeflateDestroyInflater(void* state)
+{
+  libdeflate_free_decompressor((struct libdeflate_decompressor*)state);
+}
+
+static bool
+libdeflateInflate(void* state,
+                  const unsigned char* in,
+                  size_t inSize,
+                  unsigned char* out,
+                  size_t outSize)
+{
+  size_t written = 0;
+  enum libdeflate_result ret =
+      libdeflate_deflate_decompress((struct libdeflate_decompressor*)state,
+                                    in, inSize, out, outSize, &written);
+  return ret == LIBDEFLATE_SUCCESS && written == outSize;
+}
+
+static void*
+libdeflateCreateDeflater(int level, int strategy)
+{
+  // libdeflate has no strategies, it picks its own per block
+  (void)strategy;
+  return libdeflate_alloc_compressor(level < 0 ? 6 : level);
+}
+
+static void
+libdeflateDestroyDeflater(void* state)
+{
+  libdeflate_free_compressor((struct libdeflate_compressor*)state);
+}
+
+static size_t
+libdeflateDeflate(void* state,
+                  const unsigned char* in,
+                  size_t inSize,
+                  unsigned char* out,
+                  size_t outSize)
+{
+  return libdeflate_deflate_compress((struct libdeflate_compressor*)state, in,
+                                     inSize, out, outSize);
+}
+
+static uint32_t
+libdeflateCrc32(uint32_t crc, const unsigned char* data, size_t size)
+{
+  return libdeflate_crc32(crc, data, size);
+}
+
+static const codecBackend seqioCodec = {
+  .name = "libdeflate",
+  .createInflater = libdeflateCreateInflater,
+  .destroyInflater = libdeflateDestroyInflater,
+  .inflate = libdeflateInflate,
+  .createDeflater = libdeflateCreateDeflater,
+  .destroyDeflater = libdeflateDestroyDeflater,
+  .deflate = libdeflateDeflate,
+  .crc32 = libdeflateCrc32,
+};
+#else
+static void*
+zlibCreateInflater(void)
+{
+  z_stream* zs = (z_stream*)seqioMalloc(sizeof(z_stream));
+  if (zs == NULL) {
+    return NULL;
   }
-  if (sf->pravite.isEOF) {
-    return 0;
+  memset(zs, 0, sizeof(z_stream));
+  // negative window bits: raw deflate, the gzip framing is parsed by us
+  if (inflateInit2(zs, -15) != Z_OK) {
+    seqioFree(zs);
+    return NULL;
   }
-  size_t readSize = 0;
-  size_t needReadSize = sf->buffer.capacity;
-  if (sf->pravite.options->isGzipped) {
-    readSize = gzread(sf->pravite.file, sf->buffer.data, needReadSize);
-  } else {
-    readSize = fread(sf->buffer.data, 1, needReadSize, sf->pravite.file);
+  return zs;
+}
+
+static void
+zlibDestroyInflater(void* state)
+{
+  inflateEnd((z_stream*)state);
+  seqioFree(state);
+}
+
+static bool
+zlibInflate(void* state,
+            const unsigned char* in,
+            size_t inSize,
+            unsigned char* out,
+            size_t outSize)
+{
+  z_stream* zs = (z_stream*)state;
+  if (inflateReset(zs) != Z_OK) {
+    return false;
   }
-  if (readSize < needReadSize) {
-    sf->pravite.isEOF = true;
+  zs->next_in = (Bytef*)in;
+  zs->avail_in = (uInt)inSize;
+  zs->next_out = (Bytef*)out;
+  zs->avail_out = (uInt)outSize;
+  return inflate(zs, Z_FINISH) == Z_STREAM_END && zs->avail_out == 0;
+}
+
+static void*
+zlibCreateDeflater(int level, int strategy)
+{
+  z_stream* zs = (z_stream*)seqioMalloc(sizeof(z_stream));
+  if (zs == NULL) {
+    return NULL;
   }
-  sf->buffer.left = readSize;
-  sf->buffer.offset = 0;
-  return readSize;
+  memset(zs, 0, sizeof(z_stream));
+  if (deflateInit2(zs, level, Z_DEFLATED, -15, 8, strategy)
+      != Z_OK) {
+    seqioFree(zs);
+    return NULL;
+  }
+  return zs;
 }
 
-static inline void
-freshDataToFile(seqioFile* sf)
+static void
+zlibDestroyDeflater(void* state)
 {
-  if (sf->pravite.mode == seqOpenModeRead)
-    return;
-  if (sf->pravite.options->isGzipped) {
-    gzwrite(sf->pravite.file, sf->buffer.data + sf->buffer.offset,
-            sf->buffer.left);
-    gzflush(sf->pravite.file, Z_SYNC_FLUSH);
-  } else {
-    fwrite(sf->buffer.data + sf->buffer.offset, 1, sf->buffer.left,
-           sf->pravite.file);
-    fflush(sf->pravite.file);
+  deflateEnd((z_stream*)state);
+  seqioFree(state);
+}
+
+static size_t
+zlibDeflate(void* state,
+            const unsigned char* in,
+            size_t inSize,
+            unsigned char* out,
+            size_t outSize)
+{
+  z_stream* zs = (z_stream*)state;
+  if (deflateReset(zs) != Z_OK) {
+    return 0;
   }
-  sf->buffer.offset = 0;
-  sf->buffer.left = 0;
+  zs->next_in = (Bytef*)in;
+  zs->avail_in = (uInt)inSize;
+  zs->next_out = (Bytef*)out;
+  zs->avail_out = (uInt)outSize;
+  if (deflate(zs, Z_FINISH) != Z_STREAM_END) {
+    return 0;
+  }
+  return outSize - zs->avail_out;
 }
 
-void
-seqioFlush(seqioFile* sf)
+static uint32_t
+zlibCrc32(uint32_t crc, const unsigned char* data, size_t size)
 {
-  freshDataToFile(sf);
+  return (uint32_t)crc32(crc, data, (uInt)size);
 }
 
-static inline void
-writeDataToBuffer(seqioFile* sf, char* data, size_t length)
+static const codecBackend seqioCodec = {
+  .name = "zlib",
+  .createInflater = zlibCreateInflater,
+  .destroyInflater = zlibDestroyInflater,
+  .inflate = zlibInflate,
+  .createDeflater = zlibCreateDeflater,
+  .destroyDeflater = zlibDestroyDeflater,
+  .deflate = zlibDeflate,
+  .crc32 = zlibCrc32,
+};
+#endif
+
+// BGZF is a series of gzip members of at most 64 KB each, both compressed
+// and inflated, which records its own compressed size in an extra field.
+#define seqioBgzfBlockSize 65536
+// input per written block, as bgzip does, so the deflated block always fits
+#define seqioBgzfBlockInput 0xff00
+
+// bgzfReadBlock found a gzip member without the BC field, which can follow
+// BGZF blocks when other gzip data is appended to a BGZF file
+#define seqioBgzfPlainMember ((size_t)-1)
+
+// with threads > 1 every worker inflates or deflates whole blocks with its
+// own backend state, jobCount blocks are in flight at most
+#define seqioBgzfJobsPerThread 4
+
+// written after the last block so readers can tell the file is complete
+static const unsigned char bgzfEOFBlock[28] = {
+  0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff,
+  0x06, 0x00, 0x42, 0x43, 0x02, 0x00, 0x1b, 0x00, 0x03, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+typedef struct {
+  unsigned char* block;
+  size_t blockSize;
+  char* data;
+  size_t size;
+  size_t fileOffset;
+  bool done;
+} bgzfJob;
+
+typedef struct {
+  seqioBgzf* bgzf;
+  void* state;
+  seqioThread thread;
+  bool running;
+} bgzfWorkerState;
+
+struct seqioBgzf {
+  FILE* file;
+  bool writing;
+  int level;
+  int strategy;
+  void* state;
+  unsigned char* block;
+  // the inflated block being consumed, or the one being filled for writing
+  char* data;
+  size_t offset;
+  size_t left;
+  // compressed offset just past the current block
+  size_t fileOffset;
+  // jobs[queued % jobCount] is filled next, counters only ever grow
+  bgzfJob* jobs;
+  size_t jobCount;
+  size_t queued;
+  size_t picked;
+  size_t consumed;
+  bool taken;
+  bool isEOF;
+  bool stop;
+  bgzfWorkerState* workers;
+  size_t workerCount;
+  seqioMutex lock;
+  seqioCond work;
+  seqioCond ready;
+  // past a plain member the rest of the file is read through gzread
+  gzFile gz;
+  bool plain;
+};
+
+static inline uint32_t
+readLE32(const unsigned char* p)
 {
-  size_t writeSize = length;
-  size_t buffFree;
-  while (length) {
-    buffFree = sf->buffer.capacity - sf->buffer.left;
-    if (buffFree == 0) {
-      freshDataToFile(sf);
-      buffFree = sf->buffer.capacity;
-    }
-    writeSize = length < buffFree ? length : buffFree;
-    memcpy(sf->buffer.data + sf->buffer.left, data, writeSize);
-    sf->buffer.left += writeSize;
-    length -= writeSize;
-    data += writeSize;
-    if (sf->buffer.left == sf->buffer.capacity) {
-      freshDataToFile(sf);
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16
+         | (uint32_t)p[3] << 24;
+}
+
+// the 18-byte header every BGZF block starts with, as written by bgzip
+static inline bool
+isBgzfHeader(const unsigned char* h, size_t size)
+{
+  return size >= 18 && h[0] == 0x1f && h[1] == 0x8b && h[2] == 8
+         && (h[3] & 4) && h[10] == 6 && h[11] == 0 && h[12] == 'B'
+         && h[13] == 'C' && h[14] == 2 && h[15] == 0;
+}
+
+// Read the next block into block, returns its total size or 0 at the end
+// of the file. A gzip member without the BC field is left unread and
+// seqioBgzfPlainMember returned.
+static inline size_t
+bgzfReadBlock(FILE* fp, unsigned char* block)
+{
+  long start = ftell(fp);
+  size_t n = fread(block, 1, 12, fp);
+  if (n == 0) {
+    return 0;
+  }
+  if (n < 10 || block[0] != 0x1f || block[1] != 0x8b) {
+    fprintf(stderr, "Invalid BGZF block header.\n");
+    exit(1);
+  }
+  if (n < 12 || !(block[3] & 4)) {
+    fseek(fp, start, SEEK_SET);
+    return seqioBgzfPlainMember;
+  }
+  size_t xlen = block[10] | block[11] << 8;
+  if (fread(block + 12, 1, xlen, fp) != xlen) {
+    fprintf(stderr, "Truncated BGZF block.\n");
+    exit(1);
+  }
+  size_t size = 0;
+  for (size_t i = 12; i + 4 <= 12 + xlen;) {
+    size_t slen = block[i + 2] | block[i + 3] << 8;
+    if (block[i] == 'B' && block[i + 1] == 'C' && slen == 2
+        && i + 6 <= 12 + xlen) {
+      size = (block[i + 4] | block[i + 5] << 8) + 1;
+      break;
     }
+    i += 4 + slen;
+  }
+  if (size == 0) {
+    fseek(fp, start, SEEK_SET);
+    return seqioBgzfPlainMember;
+  }
+  if (size < 12 + xlen + 8) {
+    fprintf(stderr, "Invalid BGZF block size.\n");
+    exit(1);
   }
+  size_t rest = size - 12 - xlen;
+  if (fread(block + 12 + xlen, 1, rest, fp) != rest) {
+    fprintf(stderr, "Truncated BGZF block.\n");
+    exit(1);
+  }
+  return size;
 }
 
-static inline seqioString*
-seqioStringNew(size_t capacity)
+// Inflate a block read by bgzfReadBlock into data, returns the inflated
+// size which is at most seqioBgzfBlockSize.
+static inline size_t
+bgzfInflateBlock(void* state, const unsigned char* block, size_t size,
+                 char* data)
 {
-  seqioString* string = (seqioString*)seqioMalloc(sizeof(seqioString));
-  if (string == NULL) {
+  size_t xlen = block[10] | block[11] << 8;
+  size_t payload = size - 12 - xlen - 8;
+  uint32_t crc = readLE32(block + size - 8);
+  size_t inflated = readLE32(block + size - 4);
+  if (inflated > seqioBgzfBlockSize) {
+    fprintf(stderr, "Invalid BGZF block size.\n");
     exit(1);
   }
-  if (capacity) {
-    string->data = (char*)seqioMalloc(capacity);
+  if (inflated == 0) {
+    return 0;
   }
-  if (string->data == NULL) {
-    seqioFree(string);
+  if (!seqioCodec.inflate(state, block + 12 + xlen, payload,
+                          (unsigned char*)data, inflated)
+      || seqioCodec.crc32(0, (unsigned char*)data, inflated) != crc) {
+    fprintf(stderr, "Corrupted BGZF block.\n");
     exit(1);
   }
-  string->length = 0;
-  string->capacity = capacity;
-  string->data[0] = '\0';
-  return string;
+  return inflated;
 }
 
-static inline void
-seqioStringFree(seqioString* string)
+// Deflate size bytes of data into a complete block, returns its size.
+static inline size_t
+bgzfDeflateBlock(void* state, const char* data, size_t size,
+                 unsigned char* block)
 {
-  if (string == NULL) {
-    return;
+  static const unsigned char header[16] = {
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00,
+  };
+  size_t payload = seqioCodec.deflate(state, (const unsigned char*)data, size,
+                                      block + 18, seqioBgzfBlockSize - 26);
+  if (payload == 0) {
+    fprintf(stderr, "Failed to compress BGZF block.\n");
+    exit(1);
   }
-  if (string->data != NULL) {
-    seqioFree(string->data);
+  size_t blockSize = 18 + payload + 8;
+  uint32_t crc = seqioCodec.crc32(0, (const unsigned char*)data, size);
+  memcpy(block, header, 16);
+  block[16] = (blockSize - 1) & 0xff;
+  block[17] = (blockSize - 1) >> 8;
+  unsigned char* trailer = block + 18 + payload;
+  for (int i = 0; i < 4; i++) {
+    trailer[i] = (crc >> (8 * i)) & 0xff;
+    trailer[4 + i] = (size >> (8 * i)) & 0xff;
   }
-  seqioFree(string);
+  return blockSize;
 }
 
-static inline void
-seqioStringClear(seqioString* string)
+static inline void*
+bgzfCreateState(seqioBgzf* bg)
 {
-  if (string == NULL)
-    return;
-  string->length = 0;
-  string->data[0] = '\0';
-  return;
+  return bg->writing ? seqioCodec.createDeflater(bg->level, bg->strategy)
+                     : seqioCodec.createInflater();
 }
 
-// copy from kseq.h
-#define kroundup32(x)                                                         \
-  (--(x), (x) |= (x) >> 1, (x) |= (x) >> 2, (x) |= (x) >> 4, (x) |= (x) >> 8, \
-   (x) |= (x) >> 16, ++(x))
-
 static inline void
-seqioStringAppend(seqioString* string, char* data, size_t length)
+bgzfDestroyState(seqioBgzf* bg, void* state)
 {
-  if (string->length + length > string->capacity) {
-    // Grow capacity more aggressively to reduce allocations
-    size_t newCapacity = string->capacity ? string->capacity * 2 : 64;
-    if (newCapacity < string->length + length + 1) {
-      newCapacity = string->length + length + 1;
-    }
-    kroundup32(newCapacity);
-    string->capacity = newCapacity;
-    string->data = (char*)seqioRealloc(string->data, newCapacity);
-    if (string->data == NULL) {
-      return;
-    }
+  if (state == NULL) {
+    return;
+  }
+  if (bg->writing) {
+    seqioCodec.destroyDeflater(state);
+  } else {
+    seqioCodec.destroyInflater(state);
   }
-  memcpy(string->data + string->length, data, length);
-  string->length += length;
-  return;
 }
 
 static inline void
-seqioStringAppendChar(seqioString* string, char c)
+bgzfStopWorkers(seqioBgzf* bg)
 {
-  if (string->length + 1 > string->capacity) {
-    // Grow capacity more aggressively to reduce allocations
-    size_t newCapacity = string->capacity ? string->capacity * 2 : 64;
-    if (newCapacity < string->length + 1) {
-      newCapacity = string->length + 1;
-    }
-    kroundup32(newCapacity);
-    string->capacity = newCapacity;
-    string->data = (char*)seqioRealloc(string->data, newCapacity);
-    if (string->data == NULL) {
-      return;
+  mutexLock(&bg->lock);
+  bg->stop = true;
+  condBroadcast(&bg->work);
+  mutexUnlock(&bg->lock);
+  for (size_t i = 0; i < bg->workerCount; i++) {
+    if (bg->workers[i].running) {
+      threadJoin(bg->workers[i].thread);
     }
   }
-  string->data[string->length] = c;
-  string->length += 1;
 }
 
-typedef enum {
-  READ_STATUS_NONE,
-  READ_STATUS_NAME,
-  READ_STATUS_COMMENT,
-  READ_STATUS_SEQUENCE,
-  READ_STATUS_QUALITY,
-  READ_STATUS_ADD,
-} readStatus;
-
 static inline void
-resetFilePointer(seqioFile* sf)
+bgzfFree(seqioBgzf* bg)
 {
-  if (sf->pravite.options->isGzipped) {
-    gzseek(sf->pravite.file, 0, SEEK_SET);
+  if (bg == NULL) {
+    return;
+  }
+  if (bg->workers != NULL) {
+    bgzfStopWorkers(bg);
+    for (size_t i = 0; i < bg->workerCount; i++) {
+      bgzfDestroyState(bg, bg->workers[i].state);
+    }
+    for (size_t i = 0; i < bg->jobCount; i++) {
+      seqioFree(bg->jobs[i].block);
+      seqioFree(bg->jobs[i].data);
+    }
+    seqioFree(bg->workers);
+    seqioFree(bg->jobs);
+    mutexDestroy(&bg->lock);
+    condDestroy(&bg->work);
+    condDestroy(&bg->ready);
   } else {
-    fseek(sf->pravite.file, 0, SEEK_SET);
+    seqioFree(bg->data);
   }
-  sf->pravite.isEOF = false;
-  sf->pravite.state = READ_STATUS_NONE;
-  sf->buffer.left = 0;
-  sf->buffer.offset = 0;
+  if (bg->gz != NULL) {
+    gzclose(bg->gz);
+  }
+  if (bg->file != NULL && bg->file != stdout) {
+    fclose(bg->file);
+  }
+  bgzfDestroyState(bg, bg->state);
+  seqioFree(bg->block);
+  seqioFree(bg);
 }
 
-static inline void
-checkFileExist(const char* filename)
+static void*
+bgzfWorker(void* arg)
 {
-  FILE* fp = fopen(filename, "r");
-  if (fp == NULL) {
-    fprintf(stderr, "File %s does not exist.\n", filename);
-    exit(1);
+  bgzfWorkerState* worker = (bgzfWorkerState*)arg;
+  seqioBgzf* bg = worker->bgzf;
+  mutexLock(&bg->lock);
+  while (true) {
+    while (!bg->stop && bg->picked == bg->queued) {
+      condWait(&bg->work, &bg->lock);
+    }
+    if (bg->stop) {
+      break;
+    }
+    bgzfJob* job = &bg->jobs[bg->picked % bg->jobCount];
+    bg->picked++;
+    mutexUnlock(&bg->lock);
+    if (bg->writing) {
+      job->blockSize =
+          bgzfDeflateBlock(worker->state, job->data, job->size, job->block);
+    } else {
+      job->size = bgzfInflateBlock(worker->state, job->block, job->blockSize,
+                                   job->data);
+    }
+    mutexLock(&bg->lock);
+    job->done = true;
+    condBroadcast(&bg->ready);
   }
-  fclose(fp);
+  mutexUnlock(&bg->lock);
+  return NULL;
 }
 
-static inline seqioFile*
-handleStdin(seqioFile* sf)
+static inline bool
+bgzfStartWorkers(seqioBgzf* bg, size_t threads)
 {
-  sf->pravite.isEOF = false;
-  sf->buffer.data = (char*)seqioMalloc(seqioDefaultBufferSize);
-  if (sf->buffer.data == NULL) {
-    seqioFree(sf);
-    return NULL;
+  size_t jobCount = threads * seqioBgzfJobsPerThread;
+  mutexInit(&bg->lock);
+  condInit(&bg->work);
+  condInit(&bg->ready);
+  bg->workers =
+      (bgzfWorkerState*)seqioMalloc(sizeof(bgzfWorkerState) * threads);
+  if (bg->workers == NULL) {
+    return false;
   }
-  sf->buffer.capacity = seqioDefaultBufferSize;
-  sf->buffer.offset = 0;
-  sf->buffer.left = seqioDefaultBufferSize;
-  sf->pravite.type = seqioRecordTypeUnknown;
-  sf->pravite.state = READ_STATUS_NONE;
-  sf->record = NULL;
-  size_t readSize = 0;
-  size_t buffSize = 0;
-  while (!feof(stdin)) {
-    if (!sf->buffer.left) {
-      sf->buffer.data = (char*)seqioRealloc(
-          sf->buffer.data, sf->buffer.capacity + seqioDefaultBufferSize);
-      if (sf->buffer.data == NULL) {
-        seqioFree(sf);
-        return NULL;
-      }
-      sf->buffer.capacity += seqioDefaultBufferSize;
-    }
-    readSize =
-        fread(sf->buffer.data + buffSize, 1, seqioDefaultBufferSize, stdin);
-    buffSize += readSize;
-    sf->buffer.left = sf->buffer.capacity - buffSize;
+  memset(bg->workers, 0, sizeof(bgzfWorkerState) * threads);
+  bg->jobs = (bgzfJob*)seqioMalloc(sizeof(bgzfJob) * jobCount);
+  if (bg->jobs == NULL) {
+    return false;
   }
-  if (buffSize > 2) {
-    if (sf->buffer.data[0] == 0x1f
-        && ((unsigned char)sf->buffer.data[1]) == 0x8b) {
-      seqioFree(sf->buffer.data);
-      seqioFree(sf);
-      fprintf(
-          stderr,
-          "stdin is a gzip file, please use zcat or gunzip to decompress\n");
-      exit(1);
+  memset(bg->jobs, 0, sizeof(bgzfJob) * jobCount);
+  bg->jobCount = jobCount;
+  bg->workerCount = threads;
+  for (size_t i = 0; i < bg->jobCount; i++) {
+    bg->jobs[i].block = (unsigned char*)seqioMalloc(seqioBgzfBlockSize);
+    bg->jobs[i].data = (char*)seqioMalloc(seqioBgzfBlockSize);
+    if (bg->jobs[i].block == NULL || bg->jobs[i].data == NULL) {
+      return false;
     }
   }
-  sf->pravite.isEOF = true;
-  sf->buffer.left = buffSize;
-  sf->buffer.buffSize = buffSize;
-  for (size_t i = 0; i < buffSize; i++) {
-    if (sf->buffer.data[i] == '>') {
-      sf->pravite.type = seqioRecordTypeFasta;
-      break;
-    } else if (sf->buffer.data[i] == '@') {
-      sf->pravite.type = seqioRecordTypeFastq;
-      break;
+  for (size_t i = 0; i < threads; i++) {
+    bg->workers[i].bgzf = bg;
+    bg->workers[i].state = bgzfCreateState(bg);
+    if (bg->workers[i].state == NULL) {
+      return false;
+    }
+    bg->workers[i].running =
+        threadCreate(&bg->workers[i].thread, bgzfWorker, &bg->workers[i]);
+    if (!bg->workers[i].running) {
+      return false;
     }
   }
-  return sf;
+  return true;
 }
 
-static inline void
-seqioStats(seqioFile* sf)
+static inline seqioBgzf*
+bgzfOpen(const char* filename,
+         bool writing,
+         int threads,
+         int level,
+         int strategy)
 {
-  if (sf->pravite.mode == seqOpenModeRead && sf->fromFile) {
-    if (sf->pravite.options->isGzipped) {
-      gzseek((gzFile)sf->pravite.file, 0, SEEK_END);
-      sf->fileStats.fileSize = gztell((gzFile)sf->pravite.file);
-      gzseek((gzFile)sf->pravite.file, 0, SEEK_SET);
-    } else {
-      fseek((FILE*)sf->pravite.file, 0, SEEK_END);
-      sf->fileStats.fileSize = ftell((FILE*)sf->pravite.file);
-      fseek((FILE*)sf->pravite.file, 0, SEEK_SET);
-    }
-    sf->fileStats.fileOffset = 0;
+  seqioBgzf* bg = (seqioBgzf*)seqioMalloc(sizeof(seqioBgzf));
+  if (bg == NULL) {
+    return NULL;
   }
-}
-
-static inline void
-seqioTell(seqioFile* sf)
-{
-  if (sf->pravite.mode == seqOpenModeRead && sf->fromFile) {
-    if (sf->pravite.options->isGzipped) {
-      sf->fileStats.fileOffset = gztell((gzFile)sf->pravite.file);
-    } else {
-      sf->fileStats.fileOffset = ftell((FILE*)sf->pravite.file);
+  memset(bg, 0, sizeof(seqioBgzf));
+  bg->writing = writing;
+  bg->level = level;
+  bg->strategy = strategy;
+  if (writing) {
+    bg->file = filename ? fopen(filename, "wb") : stdout;
+  } else {
+    bg->file = fopen(filename, "rb");
+  }
+  bg->block = (unsigned char*)seqioMalloc(seqioBgzfBlockSize);
+  if (bg->file == NULL || bg->block == NULL) {
+    bgzfFree(bg);
+    return NULL;
+  }
+  if (threads > 1) {
+    if (!bgzfStartWorkers(bg, threads)) {
+      bgzfFree(bg);
+      return NULL;
     }
-    if (sf->fileStats.fileOffset == sf->fileStats.fileSize) {
-      if (sf->buffer.left && !sf->pravite.options->isGzipped) {
-        // only plain file can compute the offset
-        sf->fileStats.fileOffset -= sf->buffer.left;
-      }
+    if (writing) {
+      bg->data = bg->jobs[0].data;
     }
+    return bg;
+  }
+  bg->state = bgzfCreateState(bg);
+  bg->data = (char*)seqioMalloc(seqioBgzfBlockSize);
+  if (bg->state == NULL || bg->data == NULL) {
+    bgzfFree(bg);
+    return NULL;
   }
+  return bg;
 }
 
-seqioFile*
-seqioOpen(seqioOpenOptions* options)
+// Read the rest of the file from the plain member at the current offset on
+// the way gzread reads any gzip file, BGZF members after it included.
+static inline bool
+bgzfOpenPlain(seqioBgzf* bg)
 {
-  if (options->filename && options->mode == seqOpenModeRead) {
-    checkFileExist(options->filename);
+  long offset = ftell(bg->file);
+#ifdef _WIN32
+  int fd = _dup(_fileno(bg->file));
+  if (fd >= 0 && _lseeki64(fd, offset, SEEK_SET) < 0) {
+    _close(fd);
+    fd = -1;
   }
-  int checkFileType = true;
-  if (!options->filename) {
-    options->isGzipped = false;
-    checkFileType = false;
+#else
+  int fd = dup(fileno(bg->file));
+  if (fd >= 0 && lseek(fd, offset, SEEK_SET) < 0) {
+    close(fd);
+    fd = -1;
   }
-  seqioFile* sf = (seqioFile*)seqioMalloc(sizeof(seqioFile));
-  memset(sf, 0, sizeof(seqioFile));
-  if (sf == NULL) {
-    return NULL;
+#endif
+  bg->gz = fd >= 0 ? gzdopen(fd, "rb") : NULL;
+  if (bg->gz == NULL) {
+    fprintf(stderr, "Failed to read the gzip member at offset %ld.\n",
+            offset);
+    exit(1);
   }
-  sf->pravite.options = options;
-  sf->fromFile = true;
-  if (!options->filename) {
-    if (options->mode == seqOpenModeWrite) {
-      sf->pravite.toStdout = true;
-      sf->pravite.file = stdout;
-    } else {
-      sf->fromFile = false;
-      sf->pravite.fromStdin = true;
-      sf->pravite.file = stdin;
-      return handleStdin(sf);
-    }
+  gzbuffer(bg->gz, seqioBgzfBlockSize);
+  return true;
+}
+
+static inline bool
+bgzfNextPlain(seqioBgzf* bg)
+{
+  if (bg->workers != NULL) {
+    // the inflated buffers belong to the jobs, the block one is free now
+    bg->data = (char*)bg->block;
   }
-  if (checkFileType && options->mode == seqOpenModeRead) {
-    FILE* fp = fopen(options->filename, "rb");
-    if (fp == NULL) {
-      seqioFree(sf);
-      return NULL;
-    }
-    unsigned char magic[2] = { 0 };
-    size_t bytesRead = fread(magic, 1, 2, fp);
-    fclose(fp);
-    if (bytesRead == 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
-      options->isGzipped = true;
-    } else {
-      options->isGzipped = false;
-    }
+  int n = gzread(bg->gz, bg->data, seqioBgzfBlockSize);
+  bg->offset = 0;
+  bg->left = n > 0 ? n : 0;
+  bg->fileOffset = gzoffset(bg->gz);
+  return bg->left > 0;
+}
+
+// Make the next inflated block current, returns false at the end of the
+// file. The caller thread reads compressed blocks ahead into free jobs and
+// takes inflated ones back in file order.
+static inline bool
+bgzfNextBlock(seqioBgzf* bg)
+{
+  if (bg->gz != NULL) {
+    return bgzfNextPlain(bg);
   }
-  if (options->isGzipped) {
-    sf->pravite.file = gzopen(options->filename, getOpenModeStr(options));
-    if (sf->pravite.file == NULL) {
-      seqioFree(sf);
-      return NULL;
+  if (bg->workers == NULL) {
+    size_t blockSize = bgzfReadBlock(bg->file, bg->block);
+    if (blockSize == seqioBgzfPlainMember) {
+      return bgzfOpenPlain(bg) && bgzfNextPlain(bg);
     }
-  } else {
-    if (!sf->pravite.file) {
-      sf->pravite.file = fopen(options->filename, getOpenModeStr(options));
+    if (blockSize == 0) {
+      return false;
     }
+    bg->left = bgzfInflateBlock(bg->state, bg->block, blockSize, bg->data);
+    bg->offset = 0;
+    bg->fileOffset = ftell(bg->file);
+    return true;
   }
-  size_t buff_size = seqioDefaultBufferSize;
-  if (options->mode == seqOpenModeWrite) {
-    buff_size = seqioDefaultWriteBufferSize;
+  mutexLock(&bg->lock);
+  if (bg->taken) {
+    bg->jobs[bg->consumed % bg->jobCount].done = false;
+    bg->consumed++;
+    bg->taken = false;
   }
-  sf->buffer.data = (char*)seqioMalloc(buff_size);
-  if (sf->buffer.data == NULL) {
-    fclose(sf->pravite.file);
-    seqioFree(sf);
-    return NULL;
+  mutexUnlock(&bg->lock);
+  while (!bg->isEOF && bg->queued - bg->consumed < bg->jobCount) {
+    // only jobs past queued are written here, workers never look at them
+    bgzfJob* job = &bg->jobs[bg->queued % bg->jobCount];
+    job->blockSize = bgzfReadBlock(bg->file, job->block);
+    if (job->blockSize == 0 || job->blockSize == seqioBgzfPlainMember) {
+      // the blocks queued so far are handed out before a plain member
+      bg->plain = job->blockSize != 0;
+      bg->isEOF = true;
+      break;
+    }
+    job->fileOffset = ftell(bg->file);
+    mutexLock(&bg->lock);
+    bg->queued++;
+    condSignal(&bg->work);
+    mutexUnlock(&bg->lock);
   }
-  sf->buffer.capacity = buff_size;
-  sf->buffer.offset = 0;
-  sf->buffer.left = 0;
-  sf->pravite.type = seqioRecordTypeUnknown;
-  sf->pravite.state = READ_STATUS_NONE;
-  sf->pravite.mode = options->mode;
-  sf->record = NULL;
-  sf->pravite.isEOF = false;
-  seqioStats(sf);
-  if (options->mode == seqOpenModeRead) {
-    seqioGuessType(sf);
+  if (bg->consumed == bg->queued) {
+    return bg->plain && bgzfOpenPlain(bg) && bgzfNextPlain(bg);
   }
-  return sf;
+  bgzfJob* job = &bg->jobs[bg->consumed % bg->jobCount];
+  mutexLock(&bg->lock);
+  while (!job->done) {
+    condWait(&bg->ready, &bg->lock);
+  }
+  bg->taken = true;
+  mutexUnlock(&bg->lock);
+  bg->data = job->data;
+  bg->offset = 0;
+  bg->left = job->size;
+  bg->fileOffset = job->fileOffset;
+  return true;
 }
 
-void seqioFreeRecord(seqioRecord* record);
-
-void
-seqioClose(seqioFile* sf)
+static inline size_t
+bgzfRead(seqioBgzf* bg, char* data, size_t size)
 {
-  if (sf == NULL) {
-    return;
-  }
-  if (sf->pravite.file != NULL) {
-    if (sf->pravite.mode == seqOpenModeWrite) {
-      freshDataToFile(sf);
-    }
-    if (sf->pravite.options->isGzipped) {
-      if (sf->pravite.mode == seqOpenModeWrite) {
-        gzflush(sf->pravite.file, Z_FINISH);
+  size_t total = 0;
+  while (total < size) {
+    if (bg->left == 0) {
+      if (!bgzfNextBlock(bg)) {
+        break;
       }
-      gzclose(sf->pravite.file);
-    } else {
-      if (sf->pravite.mode == seqOpenModeWrite) {
-        fflush(sf->pravite.file);
+      continue;
+    }
+    size_t n = size - total < bg->left ? size - total : bg->left;
+    memcpy(data + total, bg->data + bg->offset, n);
+    bg->offset += n;
+    bg->left -= n;
+    total += n;
+  }
+  return total;
+}
+
+static inline void
+bgzfRewind(seqioBgzf* bg)
+{
+  if (bg->workers != NULL) {
+    // let the workers finish what is queued before the jobs are reused
+    mutexLock(&bg->lock);
+    for (size_t i = bg->consumed; i < bg->queued; i++) {
+      while (!bg->jobs[i % bg->jobCount].done) {
+        condWait(&bg->ready, &bg->lock);
       }
-      fclose(sf->pravite.file);
+      bg->jobs[i % bg->jobCount].done = false;
     }
+    bg->queued = 0;
+    bg->picked = 0;
+    bg->consumed = 0;
+    bg->taken = false;
+    bg->isEOF = false;
+    bg->plain = false;
+    mutexUnlock(&bg->lock);
   }
-  if (sf->buffer.data != NULL) {
-    seqioFree(sf->buffer.data);
+  if (bg->gz != NULL) {
+    gzclose(bg->gz);
+    bg->gz = NULL;
   }
-  if (sf->record != NULL && sf->pravite.options->freeRecordOnEOF) {
-    seqioFreeRecord(sf->record);
+  fseek(bg->file, 0, SEEK_SET);
+  bg->offset = 0;
+  bg->left = 0;
+  bg->fileOffset = 0;
+}
+
+// Wait for the oldest submitted block and write it out, blocks reach the
+// file in the order they were submitted.
+static inline void
+bgzfWriteOldest(seqioBgzf* bg)
+{
+  bgzfJob* job = &bg->jobs[bg->consumed % bg->jobCount];
+  mutexLock(&bg->lock);
+  while (!job->done) {
+    condWait(&bg->ready, &bg->lock);
   }
-  seqioFree(sf);
+  job->done = false;
+  mutexUnlock(&bg->lock);
+  fwrite(job->block, 1, job->blockSize, bg->file);
+  bg->consumed++;
 }
 
-void
-seqioReset(seqioFile* sf)
+// Hand the block being filled to the workers, or deflate it right here
+// without them.
+static inline void
+bgzfSubmit(seqioBgzf* bg)
 {
-  if (sf == NULL) {
+  if (bg->left == 0) {
     return;
   }
-  if (sf->pravite.options->mode == seqOpenModeWrite) {
+  if (bg->workers == NULL) {
+    size_t blockSize = bgzfDeflateBlock(bg->state, bg->data, bg->left,
+                                        bg->block);
+    fwrite(bg->block, 1, blockSize, bg->file);
+    bg->left = 0;
     return;
   }
-  if (sf->pravite.fromStdin) {
-    return;
+  bg->jobs[bg->queued % bg->jobCount].size = bg->left;
+  mutexLock(&bg->lock);
+  bg->queued++;
+  condSignal(&bg->work);
+  mutexUnlock(&bg->lock);
+  if (bg->queued - bg->consumed == bg->jobCount) {
+    bgzfWriteOldest(bg);
   }
-  resetFilePointer(sf);
-  resetBuffer(sf);
-  if (sf->record != NULL) {
-    seqioStringClear(sf->record->name);
-    seqioStringClear(sf->record->comment);
-    seqioStringClear(sf->record->sequence);
-    seqioStringClear(sf->record->quality);
+  bg->data = bg->jobs[bg->queued % bg->jobCount].data;
+  bg->left = 0;
+}
+
+static inline void
+bgzfWrite(seqioBgzf* bg, const char* data, size_t size)
+{
+  while (size) {
+    size_t n = seqioBgzfBlockInput - bg->left;
+    n = size < n ? size : n;
+    memcpy(bg->data + bg->left, data, n);
+    bg->left += n;
+    data += n;
+    size -= n;
+    if (bg->left == seqioBgzfBlockInput) {
+      bgzfSubmit(bg);
+    }
   }
-  sf->pravite.state = READ_STATUS_NONE;
-  sf->pravite.isEOF = false;
-  sf->fileStats.fileOffset = 0;
 }
 
-seqioRecordType
-seqioGuessType(seqioFile* sf)
+// End the current block and write out everything submitted so far.
+static inline void
+bgzfFlush(seqioBgzf* bg)
 {
-  if (sf->pravite.type != seqioRecordTypeUnknown) {
-    return sf->pravite.type;
+  bgzfSubmit(bg);
+  while (bg->workers != NULL && bg->consumed < bg->queued) {
+    bgzfWriteOldest(bg);
   }
-  if (sf->pravite.options->mode != seqOpenModeRead) {
-    return seqioRecordTypeUnknown;
+  fflush(bg->file);
+}
+
+static inline void
+bgzfFinish(seqioBgzf* bg)
+{
+  bgzfFlush(bg);
+  fwrite(bgzfEOFBlock, 1, sizeof(bgzfEOFBlock), bg->file);
+  fflush(bg->file);
+}
+
+// A .gzi lists, as bgzip -i does, the compressed and uncompressed offset of
+// every block but the first as little-endian 64-bit pairs after their
+// count. Fetching from a BGZF file inflates only the blocks a region falls
+// into and keeps the last few inflated blocks around.
+#define seqioGziCacheBlocks 16
+
+typedef struct {
+  size_t fileOffset;
+  // compressed offset of the block after this one
+  size_t nextOffset;
+  size_t size;
+  size_t lastUse;
+  char* data;
+} gziBlock;
+
+struct seqioGzi {
+  // offsets of every block start, the first block included
+  size_t count;
+  size_t* fileOffsets;
+  size_t* offsets;
+  FILE* file;
+  void* state;
+  unsigned char* block;
+  gziBlock cache[seqioGziCacheBlocks];
+  size_t clock;
+};
+
+static inline void
+writeLE64(unsigned char* p, uint64_t v)
+{
+  for (int i = 0; i < 8; i++) {
+    p[i] = (v >> (8 * i)) & 0xff;
   }
-  seqioRecordType type = seqioRecordTypeUnknown;
-  int flag = 0;
-  while (!sf->pravite.isEOF) {
-    if (flag == 1) {
-      break;
-    }
-    size_t readSize = readDataToBuffer(sf);
-    if (readSize == 0) {
-      return seqioRecordTypeUnknown;
+}
+
+static inline uint64_t
+readLE64(const unsigned char* p)
+{
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; i--) {
+    v = v << 8 | p[i];
+  }
+  return v;
+}
+
+// Write filename.gzi for a BGZF file by walking its block headers.
+bool
+seqioBuildGzi(const char* filename)
+{
+  FILE* fp = fopen(filename, "rb");
+  if (fp == NULL) {
+    fprintf(stderr, "Failed to open %s.\n", filename);
+    return false;
+  }
+  unsigned char* block = (unsigned char*)seqioMalloc(seqioBgzfBlockSize);
+  size_t capacity = 1024;
+  unsigned char* pairs = (unsigned char*)seqioMalloc(8 + 16 * capacity);
+  if (block == NULL || pairs == NULL) {
+    fprintf(stderr, "Failed to allocate the block index.\n");
+    exit(1);
+  }
+  size_t count = 0;
+  size_t fileOffset = 0;
+  size_t offset = 0;
+  size_t blockSize;
+  while ((blockSize = bgzfReadBlock(fp, block)) > 0) {
+    if (blockSize == seqioBgzfPlainMember) {
+      fprintf(stderr, "Cannot index %s, it is not BGZF after byte %zu.\n",
+              filename, fileOffset);
+      fclose(fp);
+      seqioFree(block);
+      seqioFree(pairs);
+      return false;
     }
-    for (size_t i = 0; i < readSize; i++) {
-      if (sf->buffer.data[i] == '>') {
-        type = seqioRecordTypeFasta;
-        flag = 1;
-        break;
-      } else if (sf->buffer.data[i] == '@') {
-        type = seqioRecordTypeFastq;
-        flag = 1;
-        break;
+    size_t inflated = readLE32(block + blockSize - 4);
+    // empty blocks, like the EOF marker, hold nothing to fetch
+    if (fileOffset > 0 && inflated > 0) {
+      if (count == capacity) {
+        capacity *= 2;
+        pairs = (unsigned char*)seqioRealloc(pairs, 8 + 16 * capacity);
+        if (pairs == NULL) {
+          fprintf(stderr, "Failed to allocate the block index.\n");
+          exit(1);
+        }
       }
+      writeLE64(pairs + 8 + 16 * count, fileOffset);
+      writeLE64(pairs + 8 + 16 * count + 8, offset);
+      count++;
     }
+    fileOffset += blockSize;
+    offset += inflated;
   }
-  resetFilePointer(sf);
-  sf->pravite.type = type;
-  return type;
+  fclose(fp);
+  seqioFree(block);
+  writeLE64(pairs, count);
+  size_t length = strlen(filename);
+  char* path = (char*)seqioMalloc(length + 5);
+  bool ok = false;
+  if (path != NULL) {
+    memcpy(path, filename, length);
+    memcpy(path + length, ".gzi", 5);
+    FILE* out = fopen(path, "wb");
+    if (out != NULL) {
+      ok = fwrite(pairs, 1, 8 + 16 * count, out) == 8 + 16 * count;
+      ok = fclose(out) == 0 && ok;
+    }
+    if (!ok) {
+      fprintf(stderr, "Failed to create %s.\n", path);
+    }
+  }
+  seqioFree(path);
+  seqioFree(pairs);
+  return ok;
 }
 
-void
-seqioFreeRecord(seqioRecord* record)
+static void
+gziFree(seqioGzi* gzi)
 {
-  if (record == NULL) {
+  if (gzi == NULL) {
     return;
   }
-  if (record->comment) {
-    seqioStringFree(record->comment);
-  }
-  if (record->name) {
-    seqioStringFree(record->name);
+  if (gzi->file != NULL) {
+    fclose(gzi->file);
   }
-  if (record->sequence) {
-    seqioStringFree(record->sequence);
+  if (gzi->state != NULL) {
+    seqioCodec.destroyInflater(gzi->state);
   }
-  if (record->quality) {
-    seqioStringFree(record->quality);
+  for (int i = 0; i < seqioGziCacheBlocks; i++) {
+    seqioFree(gzi->cache[i].data);
   }
-  seqioFree(record);
+  seqioFree(gzi->block);
+  seqioFree(gzi->fileOffsets);
+  seqioFree(gzi->offsets);
+  seqioFree(gzi);
 }
 
-static inline void
-ensureFastqRecord(seqioFile* sf, const char* msg)
+// Load filename.gzi, NULL if there is none or it is malformed.
+static seqioGzi*
+gziLoad(const char* filename)
 {
-  if (sf->pravite.type != seqioRecordTypeFastq) {
-    fprintf(stderr, "%s\n", msg);
-    exit(1);
+  size_t length = strlen(filename);
+  char* path = (char*)seqioMalloc(length + 5);
+  if (path == NULL) {
+    return NULL;
+  }
+  memcpy(path, filename, length);
+  memcpy(path + length, ".gzi", 5);
+  FILE* fp = fopen(path, "rb");
+  seqioFree(path);
+  if (fp == NULL) {
+    return NULL;
+  }
+  seqioGzi* gzi = (seqioGzi*)seqioMalloc(sizeof(seqioGzi));
+  if (gzi == NULL) {
+    fclose(fp);
+    return NULL;
+  }
+  memset(gzi, 0, sizeof(seqioGzi));
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  unsigned char pair[16];
+  bool ok = size >= 8 && fread(pair, 1, 8, fp) == 8;
+  uint64_t count = ok ? readLE64(pair) : 0;
+  // the count is not trusted further than the pairs the file can hold
+  ok = ok && count <= ((uint64_t)size - 8) / 16;
+  if (ok) {
+    gzi->fileOffsets = (size_t*)seqioMalloc(sizeof(size_t) * (count + 1));
+    gzi->offsets = (size_t*)seqioMalloc(sizeof(size_t) * (count + 1));
+    ok = gzi->fileOffsets != NULL && gzi->offsets != NULL;
+  }
+  if (ok) {
+    gzi->fileOffsets[0] = 0;
+    gzi->offsets[0] = 0;
+    gzi->count = 1;
+  }
+  for (size_t i = 0; ok && i < count; i++) {
+    if (fread(pair, 1, 16, fp) != 16) {
+      ok = false;
+      break;
+    }
+    gzi->fileOffsets[gzi->count] = readLE64(pair);
+    gzi->offsets[gzi->count] = readLE64(pair + 8);
+    ok = gzi->offsets[gzi->count] >= gzi->offsets[gzi->count - 1];
+    gzi->count++;
+  }
+  fclose(fp);
+  gzi->file = ok ? fopen(filename, "rb") : NULL;
+  gzi->state = gzi->file ? seqioCodec.createInflater() : NULL;
+  gzi->block = (unsigned char*)seqioMalloc(seqioBgzfBlockSize);
+  if (gzi->state == NULL || gzi->block == NULL) {
+    fprintf(stderr, "Failed to load the block index of %s.\n", filename);
+    gziFree(gzi);
+    return NULL;
+  }
+  for (int i = 0; i < seqioGziCacheBlocks; i++) {
+    gzi->cache[i].fileOffset = SIZE_MAX;
   }
+  return gzi;
 }
 
-static inline void
-ensureFastaRecord(seqioFile* sf, const char* msg)
+// Return the inflated block at a compressed offset, from the cache if it
+// is there, otherwise in place of the least recently used one.
+static inline gziBlock*
+gziBlockAt(seqioGzi* gzi, size_t fileOffset)
 {
-  if (sf->pravite.type != seqioRecordTypeFasta) {
-    fprintf(stderr, "%s\n", msg);
-    exit(1);
+  gziBlock* oldest = &gzi->cache[0];
+  for (int i = 0; i < seqioGziCacheBlocks; i++) {
+    gziBlock* b = &gzi->cache[i];
+    if (b->fileOffset == fileOffset) {
+      b->lastUse = ++gzi->clock;
+      return b;
+    }
+    if (b->lastUse < oldest->lastUse) {
+      oldest = b;
+    }
+  }
+  if (oldest->data == NULL) {
+    oldest->data = (char*)seqioMalloc(seqioBgzfBlockSize);
+    if (oldest->data == NULL) {
+      return NULL;
+    }
   }
+  oldest->fileOffset = SIZE_MAX;
+  if (fseek(gzi->file, fileOffset, SEEK_SET) != 0) {
+    return NULL;
+  }
+  size_t blockSize = bgzfReadBlock(gzi->file, gzi->block);
+  if (blockSize == 0 || blockSize == seqioBgzfPlainMember) {
+    return NULL;
+  }
+  oldest->size =
+      bgzfInflateBlock(gzi->state, gzi->block, blockSize, oldest->data);
+  oldest->fileOffset = fileOffset;
+  oldest->nextOffset = fileOffset + blockSize;
+  oldest->lastUse = ++gzi->clock;
+  return oldest;
 }
 
-static inline void
-readUntil(seqioFile* sf, seqioString* s, char untilChar, readStatus nextStatus)
+// Copy size uncompressed bytes from offset on into data.
+static inline bool
+gziRead(seqioGzi* gzi, size_t offset, size_t size, char* data)
 {
-  while (1) {
-    size_t readSize = readDataToBuffer(sf);
-    if (readSize == 0) {
-      break;
+  // the last block starting at or before offset
+  size_t lo = 0;
+  size_t hi = gzi->count;
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (gzi->offsets[mid] <= offset) {
+      lo = mid;
+    } else {
+      hi = mid;
     }
-    char* buff = sf->buffer.data + sf->buffer.offset;
-    if (buff[0] == untilChar) {
-      sf->buffer.offset++;
-      sf->buffer.left--;
-      sf->pravite.state = nextStatus;
+  }
+  size_t fileOffset = gzi->fileOffsets[lo];
+  size_t blockStart = gzi->offsets[lo];
+  while (size > 0) {
+    gziBlock* b = gziBlockAt(gzi, fileOffset);
+    if (b == NULL) {
+      return false;
+    }
+    if (offset < blockStart + b->size) {
+      size_t n = blockStart + b->size - offset;
+      n = n < size ? n : size;
+      memcpy(data, b->data + (offset - blockStart), n);
+      data += n;
+      offset += n;
+      size -= n;
+    }
+    blockStart += b->size;
+    fileOffset = b->nextOffset;
+  }
+  return true;
+}
+
+static inline size_t
+readFromFile(seqioFile* sf, char* data, size_t size)
+{
+  if (sf->pravite.bgzf) {
+    return bgzfRead(sf->pravite.bgzf, data, size);
+  }
+  if (sf->pravite.options->isGzipped) {
+    int readSize = gzread(sf->pravite.file, data, size);
+    return readSize > 0 ? readSize : 0;
+  }
+  return fread(data, 1, size, sf->pravite.file);
+}
+
+static inline size_t
+tellFile(seqioFile* sf)
+{
+  if (sf->pravite.bgzf) {
+    return sf->pravite.bgzf->fileOffset;
+  }
+  if (sf->pravite.options->isGzipped) {
+    return gzoffset((gzFile)sf->pravite.file);
+  }
+  return ftell((FILE*)sf->pravite.file);
+}
+
+// With readAhead a background thread keeps reading (and inflating) into a
+// ring of large buffers while the parser works on the oldest filled one.
+typedef struct {
+  char* data;
+  size_t size;
+  size_t fileOffset;
+  bool isEOF;
+} readAheadSlot;
+
+struct seqioReadAhead {
+  seqioFile* sf;
+  readAheadSlot slots[seqioReadAheadSlots];
+  // the parser owns slots[head] once it has taken it, the thread fills
+  // slots[tail], filled counts both
+  size_t head;
+  size_t tail;
+  size_t filled;
+  bool taken;
+  bool stop;
+  bool running;
+  seqioMutex lock;
+  seqioCond notEmpty;
+  seqioCond notFull;
+  seqioThread thread;
+};
+
+static void*
+readAheadWorker(void* arg)
+{
+  seqioReadAhead* ra = (seqioReadAhead*)arg;
+  mutexLock(&ra->lock);
+  while (!ra->stop) {
+    while (ra->filled == seqioReadAheadSlots && !ra->stop) {
+      condWait(&ra->notFull, &ra->lock);
+    }
+    if (ra->stop) {
+      break;
+    }
+    readAheadSlot* slot = &ra->slots[ra->tail];
+    mutexUnlock(&ra->lock);
+    // the file is only touched by this thread while it is running
+    slot->size = readFromFile(ra->sf, slot->data, seqioReadAheadBufferSize);
+    slot->isEOF = slot->size < seqioReadAheadBufferSize;
+    slot->fileOffset = ra->sf->fromFile ? tellFile(ra->sf) : 0;
+    mutexLock(&ra->lock);
+    ra->tail = (ra->tail + 1) % seqioReadAheadSlots;
+    ra->filled++;
+    condSignal(&ra->notEmpty);
+    if (slot->isEOF) {
+      break;
+    }
+  }
+  mutexUnlock(&ra->lock);
+  return NULL;
+}
+
+static inline bool
+readAheadStart(seqioReadAhead* ra)
+{
+  ra->head = 0;
+  ra->tail = 0;
+  ra->filled = 0;
+  ra->taken = false;
+  ra->stop = false;
+  ra->running = threadCreate(&ra->thread, readAheadWorker, ra);
+  return ra->running;
+}
+
+static inline void
+readAheadStop(seqioReadAhead* ra)
+{
+  if (!ra->running) {
+    return;
+  }
+  mutexLock(&ra->lock);
+  ra->stop = true;
+  condBroadcast(&ra->notFull);
+  mutexUnlock(&ra->lock);
+  threadJoin(ra->thread);
+  ra->running = false;
+}
+
+static inline void
+readAheadFree(seqioReadAhead* ra)
+{
+  if (ra == NULL) {
+    return;
+  }
+  readAheadStop(ra);
+  for (size_t i = 0; i < seqioReadAheadSlots; i++) {
+    seqioFree(ra->slots[i].data);
+  }
+  mutexDestroy(&ra->lock);
+  condDestroy(&ra->notEmpty);
+  condDestroy(&ra->notFull);
+  seqioFree(ra);
+}
+
+static inline seqioReadAhead*
+readAheadNew(seqioFile* sf)
+{
+  seqioReadAhead* ra = (seqioReadAhead*)seqioMalloc(sizeof(seqioReadAhead));
+  if (ra == NULL) {
+    return NULL;
+  }
+  memset(ra, 0, sizeof(seqioReadAhead));
+  ra->sf = sf;
+  mutexInit(&ra->lock);
+  condInit(&ra->notEmpty);
+  condInit(&ra->notFull);
+  for (size_t i = 0; i < seqioReadAheadSlots; i++) {
+    ra->slots[i].data = (char*)seqioMalloc(seqioReadAheadBufferSize);
+    if (ra->slots[i].data == NULL) {
+      readAheadFree(ra);
+      return NULL;
+    }
+  }
+  if (!readAheadStart(ra)) {
+    readAheadFree(ra);
+    return NULL;
+  }
+  return ra;
+}
+
+static inline size_t
+readAheadNext(seqioFile* sf)
+{
+  seqioReadAhead* ra = sf->pravite.readAhead;
+  mutexLock(&ra->lock);
+  if (ra->taken) {
+    // hand the drained buffer back to the thread
+    ra->head = (ra->head + 1) % seqioReadAheadSlots;
+    ra->filled--;
+    ra->taken = false;
+    condSignal(&ra->notFull);
+  }
+  while (ra->filled == 0) {
+    condWait(&ra->notEmpty, &ra->lock);
+  }
+  readAheadSlot* slot = &ra->slots[ra->head];
+  ra->taken = true;
+  mutexUnlock(&ra->lock);
+  sf->buffer.data = slot->data;
+  sf->buffer.capacity = seqioReadAheadBufferSize;
+  sf->buffer.offset = 0;
+  sf->buffer.left = slot->size;
+  sf->pravite.isEOF = slot->isEOF;
+  return slot->size;
+}
+
+static inline size_t
+readDataToBuffer(seqioFile* sf)
+{
+  ensureReadable(sf);
+  if (sf->buffer.left) {
+    return sf->buffer.left;
+  }
+  if (sf->pravite.isEOF) {
+    return 0;
+  }
+  if (sf->pravite.readAhead) {
+    return readAheadNext(sf);
+  }
+  size_t needReadSize = sf->buffer.capacity;
+  size_t readSize = readFromFile(sf, sf->buffer.data, needReadSize);
+  if (readSize < needReadSize) {
+    sf->pravite.isEOF = true;
+  }
+  sf->buffer.left = readSize;
+  sf->buffer.offset = 0;
+  return readSize;
+}
+
+// Push everything written so far to the OS. A sync flush ends the current
+// deflate block, so it costs ratio and is only done when asked for.
+static inline void
+flushFile(seqioFile* sf)
+{
+  if (sf->pravite.bgzf) {
+    bgzfFlush(sf->pravite.bgzf);
+  } else if (sf->pravite.options->isGzipped) {
+    gzflush(sf->pravite.file, Z_SYNC_FLUSH);
+  } else {
+    fflush(sf->pravite.file);
+  }
+}
+
+// Hand the buffer to the file, the data may still sit in zlib or stdio
+// buffers afterwards.
+static inline void
+freshDataToFile(seqioFile* sf)
+{
+  if (sf->pravite.mode == seqOpenModeRead)
+    return;
+  if (sf->pravite.bgzf) {
+    bgzfWrite(sf->pravite.bgzf, sf->buffer.data + sf->buffer.offset,
+              sf->buffer.left);
+  } else if (sf->pravite.options->isGzipped) {
+    gzwrite(sf->pravite.file, sf->buffer.data + sf->buffer.offset,
+            sf->buffer.left);
+  } else {
+    fwrite(sf->buffer.data + sf->buffer.offset, 1, sf->buffer.left,
+           sf->pravite.file);
+  }
+  sf->buffer.offset = 0;
+  sf->buffer.left = 0;
+  if (sf->pravite.options->flushPolicy == seqioFlushEveryBuffer) {
+    flushFile(sf);
+  }
+}
+
+void
+seqioFlush(seqioFile* sf)
+{
+  if (sf->pravite.mode == seqOpenModeRead) {
+    return;
+  }
+  freshDataToFile(sf);
+  if (sf->pravite.options->flushPolicy != seqioFlushEveryBuffer) {
+    flushFile(sf);
+  }
+}
+
+static inline void
+writeDataToBuffer(seqioFile* sf, char* data, size_t length)
+{
+  size_t writeSize = length;
+  size_t buffFree;
+  while (length) {
+    buffFree = sf->buffer.capacity - sf->buffer.left;
+    if (buffFree == 0) {
+      freshDataToFile(sf);
+      buffFree = sf->buffer.capacity;
+    }
+    writeSize = length < buffFree ? length : buffFree;
+    memcpy(sf->buffer.data + sf->buffer.left, data, writeSize);
+    sf->buffer.left += writeSize;
+    length -= writeSize;
+    data += writeSize;
+    if (sf->buffer.left == sf->buffer.capacity) {
+      freshDataToFile(sf);
+    }
+  }
+}
+
+// Copy bases into the write buffer and fold their case there, so the
+// record, which may be a view into a read-only mapping, is left untouched.
+static inline void
+writeSequenceToBuffer(seqioFile* sf,
+                      char* data,
+                      size_t length,
+                      baseCase fold)
+{
+  if (fold != seqioBaseCaseLower && fold != seqioBaseCaseUpper) {
+    writeDataToBuffer(sf, data, length);
+    return;
+  }
+  size_t writeSize;
+  size_t buffFree;
+  while (length) {
+    buffFree = sf->buffer.capacity - sf->buffer.left;
+    if (buffFree == 0) {
+      freshDataToFile(sf);
+      buffFree = sf->buffer.capacity;
+    }
+    writeSize = length < buffFree ? length : buffFree;
+    char* out = sf->buffer.data + sf->buffer.left;
+    if (fold == seqioBaseCaseUpper) {
+      for (size_t i = 0; i < writeSize; i++) {
+        out[i] = data[i] & 0xDF;
+      }
+    } else {
+      for (size_t i = 0; i < writeSize; i++) {
+        out[i] = data[i] | 0x20;
+      }
+    }
+    sf->buffer.left += writeSize;
+    length -= writeSize;
+    data += writeSize;
+    if (sf->buffer.left == sf->buffer.capacity) {
+      freshDataToFile(sf);
+    }
+  }
+}
+
+// shared by every view string that has nothing to point at yet
+static char seqioEmptyString[1] = { '\0' };
+
+static inline void*
+allocatorAlloc(seqioAllocator* allocator, size_t size)
+{
+  if (allocator) {
+    return allocator->alloc(allocator->context, size);
+  }
+  return seqioMalloc(size);
+}
+
+static inline void*
+allocatorResize(seqioAllocator* allocator,
+                void* ptr,
+                size_t oldSize,
+                size_t size)
+{
+  if (allocator) {
+    return allocator->resize(allocator->context, ptr, oldSize, size);
+  }
+  return seqioRealloc(ptr, size);
+}
+
+static inline void
+allocatorRelease(seqioAllocator* allocator, void* ptr, size_t size)
+{
+  if (allocator) {
+    allocator->release(allocator->context, ptr, size);
+    return;
+  }
+  seqioFree(ptr);
+}
+
+// a string with capacity 0 is a view, its data is borrowed and never freed
+static inline seqioString*
+seqioStringNewFrom(seqioAllocator* allocator, size_t capacity)
+{
+  seqioString* string =
+      (seqioString*)allocatorAlloc(allocator, sizeof(seqioString));
+  if (string == NULL) {
+    exit(1);
+  }
+  string->allocator = allocator;
+  if (capacity) {
+    string->data = (char*)allocatorAlloc(allocator, capacity);
+    if (string->data == NULL) {
+      allocatorRelease(allocator, string, sizeof(seqioString));
+      exit(1);
+    }
+    string->data[0] = '\0';
+  } else {
+    // never written to, so it can be shared between threads
+    string->data = seqioEmptyString;
+  }
+  string->length = 0;
+  string->capacity = capacity;
+  return string;
+}
+
+static inline seqioString*
+seqioStringNew(size_t capacity)
+{
+  return seqioStringNewFrom(NULL, capacity);
+}
+
+static inline void
+seqioStringFree(seqioString* string)
+{
+  if (string == NULL) {
+    return;
+  }
+  if (string->data != NULL && string->capacity) {
+    allocatorRelease(string->allocator, string->data, string->capacity);
+  }
+  allocatorRelease(string->allocator, string, sizeof(seqioString));
+}
+
+static inline void
+seqioStringClear(seqioString* string)
+{
+  if (string == NULL)
+    return;
+  string->length = 0;
+  if (!string->capacity) {
+    string->data = seqioEmptyString;
+    return;
+  }
+  string->data[0] = '\0';
+  return;
+}
+
+static inline void
+seqioStringView(seqioString* string, char* data, size_t length)
+{
+  if (string->capacity) {
+    allocatorRelease(string->allocator, string->data, string->capacity);
+    string->capacity = 0;
+  }
+  string->data = data;
+  string->length = length;
+}
+
+// copy from kseq.h
+#define kroundup32(x)                                                         \
+  (--(x), (x) |= (x) >> 1, (x) |= (x) >> 2, (x) |= (x) >> 4, (x) |= (x) >> 8, \
+   (x) |= (x) >> 16, ++(x))
+
+static inline void
+seqioStringGrow(seqioString* string, size_t length)
+{
+  // keep one byte for the NUL terminator
+  if (string->length + length < string->capacity) {
+    return;
+  }
+  // Grow capacity more aggressively to reduce allocations
+  size_t newCapacity = string->capacity ? string->capacity * 2 : 64;
+  if (newCapacity < string->length + length + 1) {
+    newCapacity = string->length + length + 1;
+  }
+  kroundup32(newCapacity);
+  if (string->capacity) {
+    string->data = (char*)allocatorResize(string->allocator, string->data,
+                                          string->capacity, newCapacity);
+  } else {
+    // copy a view into memory owned by the string
+    char* data = (char*)allocatorAlloc(string->allocator, newCapacity);
+    if (data != NULL) {
+      memcpy(data, string->data, string->length);
+    }
+    string->data = data;
+  }
+  string->capacity = newCapacity;
+}
+
+static inline void
+seqioStringAppend(seqioString* string, char* data, size_t length)
+{
+  seqioStringGrow(string, length);
+  if (string->data == NULL) {
+    return;
+  }
+  memcpy(string->data + string->length, data, length);
+  string->length += length;
+  return;
+}
+
+static inline void
+seqioStringAppendChar(seqioString* string, char c)
+{
+  seqioStringGrow(string, 1);
+  if (string->data == NULL) {
+    return;
+  }
+  string->data[string->length] = c;
+  string->length += 1;
+}
+
+typedef enum {
+  READ_STATUS_NONE,
+  READ_STATUS_NAME,
+  READ_STATUS_COMMENT,
+  READ_STATUS_SEQUENCE,
+  READ_STATUS_QUALITY,
+  READ_STATUS_ADD,
+} readStatus;
+
+static inline char*
+mapFile(FILE* fp, size_t* size)
+{
+  char* data = NULL;
+#ifdef _WIN32
+  HANDLE file = (HANDLE)_get_osfhandle(_fileno(fp));
+  LARGE_INTEGER fileSize;
+  if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize)
+      || fileSize.QuadPart == 0) {
+    return NULL;
+  }
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping == NULL) {
+    return NULL;
+  }
+  data = (char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  // the view keeps the mapping object alive
+  CloseHandle(mapping);
+  *size = (size_t)fileSize.QuadPart;
+#else
+  struct stat st;
+  if (fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    return NULL;
+  }
+  data = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+  if (data == MAP_FAILED) {
+    return NULL;
+  }
+  posix_madvise(data, st.st_size, POSIX_MADV_SEQUENTIAL);
+  *size = st.st_size;
+#endif
+  return data;
+}
+
+static inline void
+unmapFile(char* data, size_t size)
+{
+#ifdef _WIN32
+  (void)size;
+  UnmapViewOfFile(data);
+#else
+  munmap(data, size);
+#endif
+}
+
+static inline void
+resetMappedBuffer(seqioFile* sf)
+{
+  // the whole file is one buffer which never needs a refill
+  sf->buffer.data = sf->mapping.data;
+  sf->buffer.capacity = sf->mapping.size;
+  sf->buffer.offset = 0;
+  sf->buffer.left = sf->mapping.size;
+  sf->pravite.isEOF = true;
+}
+
+static inline void
+resetFilePointer(seqioFile* sf)
+{
+  if (sf->mapping.data) {
+    resetMappedBuffer(sf);
+    sf->pravite.state = READ_STATUS_NONE;
+    return;
+  }
+  if (sf->pravite.readAhead) {
+    readAheadStop(sf->pravite.readAhead);
+  }
+  if (sf->pravite.bgzf) {
+    bgzfRewind(sf->pravite.bgzf);
+  } else if (sf->pravite.options->isGzipped) {
+    gzseek(sf->pravite.file, 0, SEEK_SET);
+  } else {
+    fseek(sf->pravite.file, 0, SEEK_SET);
+  }
+  if (sf->pravite.readAhead) {
+    readAheadStart(sf->pravite.readAhead);
+  }
+  sf->pravite.isEOF = false;
+  sf->pravite.state = READ_STATUS_NONE;
+  sf->buffer.left = 0;
+  sf->buffer.offset = 0;
+}
+
+static inline void
+checkFileExist(const char* filename)
+{
+  FILE* fp = fopen(filename, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "File %s does not exist.\n", filename);
+    exit(1);
+  }
+  fclose(fp);
+}
+
+static inline gzFile
+openStdin(void)
+{
+#ifdef _WIN32
+  _setmode(_fileno(stdin), _O_BINARY);
+  return gzdopen(_fileno(stdin), "rb");
+#else
+  // zlib passes plain input through and inflates it when it starts with the
+  // gzip magic, either way stdin is consumed as a stream
+  return gzdopen(fileno(stdin), "rb");
+#endif
+}
+
+static inline size_t
+descriptorSize(int fd)
+{
+#ifdef _WIN32
+  __int64 size = _filelengthi64(fd);
+  return size < 0 ? 0 : (size_t)size;
+#else
+  struct stat st;
+  return fstat(fd, &st) == 0 ? (size_t)st.st_size : 0;
+#endif
+}
+
+// Open gzipped input through a descriptor of our own, so its compressed
+// size is taken from the file that is actually read.
+static inline gzFile
+openGzRead(const char* filename, size_t* size)
+{
+#ifdef _WIN32
+  int fd = _open(filename, _O_RDONLY | _O_BINARY);
+#else
+  int fd = open(filename, O_RDONLY);
+#endif
+  if (fd < 0) {
+    return NULL;
+  }
+  *size = descriptorSize(fd);
+  gzFile file = gzdopen(fd, "rb");
+  if (file == NULL) {
+#ifdef _WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+  }
+  return file;
+}
+
+static inline void
+seqioStats(seqioFile* sf)
+{
+  if (sf->pravite.mode == seqOpenModeRead && sf->fromFile) {
+    if (sf->pravite.options->isGzipped) {
+      // seeking to the end of a gzip stream inflates all of it, so only the
+      // compressed size is reported, see seqioUncompressedSize. gzread input
+      // was sized from its descriptor by openGzRead.
+      if (sf->pravite.bgzf) {
+#ifdef _WIN32
+        int fd = _fileno(sf->pravite.bgzf->file);
+#else
+        int fd = fileno(sf->pravite.bgzf->file);
+#endif
+        sf->fileStats.fileSize = descriptorSize(fd);
+      }
+    } else {
+      fseek((FILE*)sf->pravite.file, 0, SEEK_END);
+      sf->fileStats.fileSize = ftell((FILE*)sf->pravite.file);
+      fseek((FILE*)sf->pravite.file, 0, SEEK_SET);
+    }
+    sf->fileStats.fileOffset = 0;
+  }
+}
+
+static inline void
+seqioTell(seqioFile* sf)
+{
+  if (sf->mapping.data) {
+    sf->fileStats.fileOffset = sf->buffer.offset;
+    return;
+  }
+  if (sf->pravite.mode == seqOpenModeRead && sf->fromFile) {
+    if (sf->pravite.readAhead) {
+      // the file belongs to the reader thread, use the offset it recorded
+      // after filling the current buffer
+      seqioReadAhead* ra = sf->pravite.readAhead;
+      sf->fileStats.fileOffset =
+          ra->taken ? ra->slots[ra->head].fileOffset : 0;
+    } else {
+      sf->fileStats.fileOffset = tellFile(sf);
+    }
+    if (sf->fileStats.fileOffset == sf->fileStats.fileSize) {
+      if (sf->buffer.left && !sf->pravite.options->isGzipped) {
+        // only plain file can compute the offset
+        sf->fileStats.fileOffset -= sf->buffer.left;
+      }
+    }
+  }
+}
+
+seqioFile*
+seqioOpen(seqioOpenOptions* options)
+{
+  if (options->filename && options->mode == seqOpenModeRead) {
+    checkFileExist(options->filename);
+  }
+  int checkFileType = true;
+  if (!options->filename) {
+    options->isGzipped = false;
+    checkFileType = false;
+  }
+  seqioFile* sf = (seqioFile*)seqioMalloc(sizeof(seqioFile));
+  memset(sf, 0, sizeof(seqioFile));
+  if (sf == NULL) {
+    return NULL;
+  }
+  sf->pravite.options = options;
+  sf->fromFile = true;
+  if (!options->filename) {
+    if (options->mode == seqOpenModeWrite) {
+      sf->pravite.toStdout = true;
+      sf->pravite.file = stdout;
+    } else {
+      sf->fromFile = false;
+      sf->pravite.fromStdin = true;
+      sf->pravite.file = openStdin();
+      if (sf->pravite.file == NULL) {
+        seqioFree(sf);
+        return NULL;
+      }
+      gzbuffer(sf->pravite.file, seqioDefaultWriteBufferSize);
+      // the handle is a gzFile whether or not the input is compressed
+      options->isGzipped = true;
+    }
+  }
+  if (checkFileType && options->mode == seqOpenModeRead) {
+    FILE* fp = fopen(options->filename, "rb");
+    if (fp == NULL) {
+      seqioFree(sf);
+      return NULL;
+    }
+    unsigned char magic[18] = { 0 };
+    size_t bytesRead = fread(magic, 1, 18, fp);
+    fclose(fp);
+    if (bytesRead >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+      options->isGzipped = true;
+    } else {
+      options->isGzipped = false;
+    }
+    if (isBgzfHeader(magic, bytesRead)) {
+      // blocks are inflated whole by the codec backend instead of gzread
+      sf->pravite.bgzf = bgzfOpen(options->filename, false, options->threads,
+                                  Z_DEFAULT_COMPRESSION, Z_DEFAULT_STRATEGY);
+      if (sf->pravite.bgzf == NULL) {
+        seqioFree(sf);
+        return NULL;
+      }
+    }
+  }
+  if (options->bgzf && options->mode == seqOpenModeWrite) {
+    // blocks are deflated whole by the codec backend instead of gzwrite,
+    // stdout included
+    options->isGzipped = true;
+    sf->pravite.file = NULL;
+    sf->pravite.bgzf = bgzfOpen(options->filename, true, options->threads,
+                                  zlibLevel(options), zlibStrategy(options));
+    if (sf->pravite.bgzf == NULL) {
+      seqioFree(sf);
+      return NULL;
+    }
+  }
+  if (options->isGzipped) {
+    // BGZF input is read through the handle of the block reader
+    if (!sf->pravite.file && !sf->pravite.bgzf) {
+      sf->pravite.file =
+          options->mode == seqOpenModeRead
+              ? openGzRead(options->filename, &sf->fileStats.fileSize)
+              : gzopen(options->filename, getOpenModeStr(options));
+    }
+    if (sf->pravite.file == NULL && !sf->pravite.bgzf) {
+      seqioFree(sf);
+      return NULL;
+    }
+    if (options->mode == seqOpenModeWrite && sf->pravite.file) {
+      gzsetparams(sf->pravite.file, zlibLevel(options), zlibStrategy(options));
+    }
+  } else {
+    if (!sf->pravite.file) {
+      sf->pravite.file = fopen(options->filename, getOpenModeStr(options));
+    }
+  }
+  if (options->zeroCopy && options->mode == seqOpenModeRead
+      && !options->isGzipped && sf->pravite.file) {
+    // fall back to buffered reading if the file cannot be mapped
+    sf->mapping.data = mapFile(sf->pravite.file, &sf->mapping.size);
+  }
+  if (sf->mapping.data) {
+    sf->mapping.sequence = seqioStringNew(256);
+    sf->mapping.quality = seqioStringNew(256);
+    sf->mapping.mateSequence = seqioStringNew(256);
+    sf->mapping.mateQuality = seqioStringNew(256);
+    resetMappedBuffer(sf);
+  } else if (options->readAhead && options->mode == seqOpenModeRead) {
+    // the buffer points into the ring once the first read arrives
+    sf->buffer.data = NULL;
+    sf->buffer.capacity = 0;
+    sf->buffer.offset = 0;
+    sf->buffer.left = 0;
+    sf->pravite.isEOF = false;
+  } else {
+    size_t buff_size = seqioDefaultBufferSize;
+    if (options->mode == seqOpenModeWrite) {
+      buff_size = seqioDefaultWriteBufferSize;
+    }
+    sf->buffer.data = (char*)seqioMalloc(buff_size);
+    if (sf->buffer.data == NULL) {
+      fclose(sf->pravite.file);
+      seqioFree(sf);
+      return NULL;
+    }
+    sf->buffer.capacity = buff_size;
+    sf->buffer.offset = 0;
+    sf->buffer.left = 0;
+    sf->pravite.isEOF = false;
+  }
+  sf->pravite.type = seqioRecordTypeUnknown;
+  sf->pravite.state = READ_STATUS_NONE;
+  sf->pravite.mode = options->mode;
+  sf->record = NULL;
+  seqioStats(sf);
+  if (options->readAhead && options->mode == seqOpenModeRead
+      && !sf->mapping.data) {
+    // from here on the file belongs to the reader thread
+    sf->pravite.readAhead = readAheadNew(sf);
+    if (sf->pravite.readAhead == NULL) {
+      seqioClose(sf);
+      return NULL;
+    }
+  }
+  if (options->mode == seqOpenModeRead) {
+    seqioGuessType(sf);
+  }
+  return sf;
+}
+
+void seqioFreeRecord(seqioRecord* record);
+static void recordIndexFree(seqioRecordIndex* ri);
+
+void
+seqioClose(seqioFile* sf)
+{
+  if (sf == NULL) {
+    return;
+  }
+  if (sf->pravite.readAhead != NULL) {
+    // the buffer points into the ring which goes away with the reader
+    readAheadFree(sf->pravite.readAhead);
+    sf->pravite.readAhead = NULL;
+    sf->buffer.data = NULL;
+  }
+  if (sf->pravite.bgzf != NULL) {
+    if (sf->pravite.mode == seqOpenModeWrite) {
+      freshDataToFile(sf);
+      bgzfFinish(sf->pravite.bgzf);
+    }
+    bgzfFree(sf->pravite.bgzf);
+  }
+  if (sf->pravite.file != NULL) {
+    if (sf->pravite.mode == seqOpenModeWrite) {
+      freshDataToFile(sf);
+    }
+    if (sf->pravite.options->isGzipped) {
+      if (sf->pravite.mode == seqOpenModeWrite) {
+        gzflush(sf->pravite.file, Z_FINISH);
+      }
+      gzclose(sf->pravite.file);
+    } else {
+      if (sf->pravite.mode == seqOpenModeWrite) {
+        fflush(sf->pravite.file);
+      }
+      fclose(sf->pravite.file);
+    }
+  }
+  if (sf->mapping.data != NULL) {
+    unmapFile(sf->mapping.data, sf->mapping.size);
+    seqioStringFree(sf->mapping.sequence);
+    seqioStringFree(sf->mapping.quality);
+    seqioStringFree(sf->mapping.mateSequence);
+    seqioStringFree(sf->mapping.mateQuality);
+  } else if (sf->buffer.data != NULL) {
+    seqioFree(sf->buffer.data);
+  }
+  // an arena may already have been reset under the last record, records
+  // from any other allocator are released through it
+  seqioAllocator* allocator = sf->pravite.options->allocator;
+  if (sf->record != NULL && sf->pravite.options->freeRecordOnEOF
+      && (allocator == NULL || !allocator->bulkRelease)) {
+    seqioFreeRecord(sf->record);
+  }
+  seqioFreeRecord(sf->pravite.batchRecord);
+  seqioIndexFree(sf->pravite.index);
+  gziFree(sf->pravite.gzi);
+  recordIndexFree(sf->pravite.recordIndex);
+  if (sf->pravite.fetchFile != NULL) {
+    fclose(sf->pravite.fetchFile);
+  }
+  seqioStringFree(sf->pravite.fetched);
+  seqioFree(sf);
+}
+
+void
+seqioReset(seqioFile* sf)
+{
+  if (sf == NULL) {
+    return;
+  }
+  if (sf->pravite.options->mode == seqOpenModeWrite) {
+    return;
+  }
+  if (sf->pravite.fromStdin) {
+    return;
+  }
+  resetFilePointer(sf);
+  resetBuffer(sf);
+  if (sf->record != NULL) {
+    seqioStringClear(sf->record->name);
+    seqioStringClear(sf->record->comment);
+    seqioStringClear(sf->record->sequence);
+    seqioStringClear(sf->record->quality);
+  }
+  sf->pravite.state = READ_STATUS_NONE;
+  sf->pravite.isEOF = false;
+  sf->fileStats.fileOffset = 0;
+}
+
+seqioRecordType
+seqioGuessType(seqioFile* sf)
+{
+  if (sf->pravite.type != seqioRecordTypeUnknown) {
+    return sf->pravite.type;
+  }
+  if (sf->pravite.options->mode != seqOpenModeRead) {
+    return seqioRecordTypeUnknown;
+  }
+  seqioRecordType type = seqioRecordTypeUnknown;
+  int flag = 0;
+  while (!flag) {
+    size_t readSize = readDataToBuffer(sf);
+    if (readSize == 0) {
+      return seqioRecordTypeUnknown;
+    }
+    char* buff = sf->buffer.data + sf->buffer.offset;
+    for (size_t i = 0; i < readSize; i++) {
+      if (buff[i] == '>') {
+        type = seqioRecordTypeFasta;
+        flag = 1;
+        break;
+      } else if (buff[i] == '@') {
+        type = seqioRecordTypeFastq;
+        flag = 1;
+        break;
+      }
+    }
+    if (!flag) {
+      // nothing but leading junk in this buffer, look at the next one
+      sf->buffer.left = 0;
+    }
+  }
+  // keep the buffer, rewinding a gzip stream would inflate it again
+  sf->pravite.type = type;
+  return type;
+}
+
+size_t
+seqioUncompressedSize(seqioFile* sf)
+{
+  if (!sf->pravite.options->isGzipped) {
+    return sf->fileStats.fileSize;
+  }
+  if (sf->fileStats.uncompressedSize || !sf->fromFile
+      || sf->pravite.mode != seqOpenModeRead) {
+    return sf->fileStats.uncompressedSize;
+  }
+  if (sf->pravite.bgzf) {
+    // every block trailer records its inflated size, nothing to inflate
+    FILE* fp = fopen(sf->pravite.options->filename, "rb");
+    unsigned char* block = (unsigned char*)seqioMalloc(seqioBgzfBlockSize);
+    size_t size = 0;
+    size_t blockSize;
+    if (fp != NULL && block != NULL) {
+      while ((blockSize = bgzfReadBlock(fp, block)) > 0) {
+        size += readLE32(block + blockSize - 4);
+      }
+    }
+    if (fp != NULL) {
+      fclose(fp);
+    }
+    seqioFree(block);
+    sf->fileStats.uncompressedSize = size;
+    return size;
+  }
+  // inflate through a separate handle so reading is not disturbed
+  gzFile file = gzopen(sf->pravite.options->filename, "rb");
+  if (file == NULL) {
+    return 0;
+  }
+  gzbuffer(file, seqioDefaultWriteBufferSize);
+  char* data = (char*)seqioMalloc(seqioDefaultWriteBufferSize);
+  if (data == NULL) {
+    gzclose(file);
+    return 0;
+  }
+  size_t size = 0;
+  int readSize;
+  while ((readSize = gzread(file, data, seqioDefaultWriteBufferSize)) > 0) {
+    size += readSize;
+  }
+  seqioFree(data);
+  gzclose(file);
+  sf->fileStats.uncompressedSize = size;
+  return size;
+}
+
+void
+seqioFreeRecord(seqioRecord* record)
+{
+  if (record == NULL) {
+    return;
+  }
+  if (record->comment) {
+    seqioStringFree(record->comment);
+  }
+  if (record->name) {
+    seqioStringFree(record->name);
+  }
+  if (record->sequence) {
+    seqioStringFree(record->sequence);
+  }
+  if (record->quality) {
+    seqioStringFree(record->quality);
+  }
+  allocatorRelease(record->allocator, record, sizeof(seqioRecord));
+}
+
+static inline void
+ensureFastqRecord(seqioFile* sf, const char* msg)
+{
+  if (sf->pravite.type != seqioRecordTypeFastq) {
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+  }
+}
+
+static inline void
+ensureFastaRecord(seqioFile* sf, const char* msg)
+{
+  if (sf->pravite.type != seqioRecordTypeFasta) {
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+  }
+}
+
+static inline void
+readUntil(seqioFile* sf, seqioString* s, char untilChar, readStatus nextStatus)
+{
+  while (1) {
+    size_t readSize = readDataToBuffer(sf);
+    if (readSize == 0) {
+      break;
+    }
+    char* buff = sf->buffer.data + sf->buffer.offset;
+    if (buff[0] == untilChar) {
+      sf->buffer.offset++;
+      sf->buffer.left--;
+      sf->pravite.state = nextStatus;
+      break;
+    }
+    char* sep_stop = memchr(buff, '\n', sf->buffer.left);
+    if (sep_stop == NULL) {
+      seqioStringAppend(s, buff, sf->buffer.left);
+      sf->buffer.left = 0;
+      sf->buffer.offset = 0;
+      continue;
+    }
+    size_t sep = sep_stop - buff;
+    if (!sep) {
+      sf->buffer.left--;
+      sf->buffer.offset++;
+      continue;
+    }
+    if (buff[sep - 1] == '\r') {
+      sep--;
+    }
+    sf->buffer.left -= sep + 1;
+    sf->buffer.offset += sep + 1;
+    seqioStringAppend(s, buff, sep);
+  }
+}
+
+// Delimiter scanning: find the first of three bytes in a buffer with the
+// widest vector unit the CPU has, picked once at runtime.
+static inline size_t
+scanAny3Scalar(const char* p, size_t n, char a, char b, char c)
+{
+  for (size_t i = 0; i < n; i++) {
+    if (p[i] == a || p[i] == b || p[i] == c) {
+      return i;
+    }
+  }
+  return n;
+}
+
+#ifdef SEQIO_SSE2
+static inline unsigned
+lowestBit(unsigned mask)
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return (unsigned)index;
+#else
+  return (unsigned)__builtin_ctz(mask);
+#endif
+}
+
+static size_t
+scanAny3SSE2(const char* p, size_t n, char a, char b, char c)
+{
+  const __m128i va = _mm_set1_epi8(a);
+  const __m128i vb = _mm_set1_epi8(b);
+  const __m128i vc = _mm_set1_epi8(c);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(p + i));
+    __m128i m = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(x, vb)),
+        _mm_cmpeq_epi8(x, vc));
+    unsigned mask = (unsigned)_mm_movemask_epi8(m);
+    if (mask) {
+      return i + lowestBit(mask);
+    }
+  }
+  return i + scanAny3Scalar(p + i, n - i, a, b, c);
+}
+#endif
+
+#ifdef SEQIO_AVX2
+__attribute__((target("avx2"))) static size_t
+scanAny3AVX2(const char* p, size_t n, char a, char b, char c)
+{
+  const __m256i va = _mm256_set1_epi8(a);
+  const __m256i vb = _mm256_set1_epi8(b);
+  const __m256i vc = _mm256_set1_epi8(c);
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(p + i));
+    __m256i m = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(x, va), _mm256_cmpeq_epi8(x, vb)),
+        _mm256_cmpeq_epi8(x, vc));
+    unsigned mask = (unsigned)_mm256_movemask_epi8(m);
+    if (mask) {
+      return i + lowestBit(mask);
+    }
+  }
+  return i + scanAny3SSE2(p + i, n - i, a, b, c);
+}
+#endif
+
+#ifdef SEQIO_NEON
+static size_t
+scanAny3NEON(const char* p, size_t n, char a, char b, char c)
+{
+  const uint8x16_t va = vdupq_n_u8((uint8_t)a);
+  const uint8x16_t vb = vdupq_n_u8((uint8_t)b);
+  const uint8x16_t vc = vdupq_n_u8((uint8_t)c);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t x = vld1q_u8((const uint8_t*)(p + i));
+    uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(x, va), vceqq_u8(x, vb)),
+                            vceqq_u8(x, vc));
+    if (vmaxvq_u8(m)) {
+      return i + scanAny3Scalar(p + i, 16, a, b, c);
+    }
+  }
+  return i + scanAny3Scalar(p + i, n - i, a, b, c);
+}
+#endif
+
+typedef size_t (*scanAny3Func)(const char*, size_t, char, char, char);
+
+static scanAny3Func
+pickScanAny3(void)
+{
+#ifdef SEQIO_AVX2
+  if (__builtin_cpu_supports("avx2")) {
+    return scanAny3AVX2;
+  }
+#endif
+#if defined(SEQIO_SSE2)
+  return scanAny3SSE2;
+#elif defined(SEQIO_NEON)
+  return scanAny3NEON;
+#else
+  return scanAny3Scalar;
+#endif
+}
+
+static inline size_t
+scanAny3(const char* p, size_t n, char a, char b, char c)
+{
+  // every thread picks the same function, so racing on the first call is
+  // harmless, the atomics only keep sanitizers quiet
+  static scanAny3Func scan = NULL;
+#ifdef __GNUC__
+  scanAny3Func f = __atomic_load_n(&scan, __ATOMIC_RELAXED);
+  if (f == NULL) {
+    f = pickScanAny3();
+    __atomic_store_n(&scan, f, __ATOMIC_RELAXED);
+  }
+#else
+  scanAny3Func f = scan;
+  if (f == NULL) {
+    f = scan = pickScanAny3();
+  }
+#endif
+  return f(p, n, a, b, c);
+}
+
+// Read until one of two delimiter characters, optimized for name/comment reading
+static inline char
+readUntilEither(seqioFile* sf, seqioString* s, char delim1, char delim2)
+{
+  while (1) {
+    size_t readSize = readDataToBuffer(sf);
+    if (readSize == 0) {
+      return '\0';
+    }
+    char* buff = sf->buffer.data + sf->buffer.offset;
+
+    // Find the first occurrence of either delimiter
+    size_t i = scanAny3(buff, sf->buffer.left, delim1, delim2, '\r');
+
+    // Append the chunk before the delimiter
+    if (i > 0) {
+      seqioStringAppend(s, buff, i);
+      sf->buffer.offset += i;
+      sf->buffer.left -= i;
+    }
+    
+    // Check if we found a delimiter
+    if (i < readSize) {
+      char found = sf->buffer.data[sf->buffer.offset];
+      if (found == '\r') {
+        // Skip \r and continue
+        sf->buffer.offset++;
+        sf->buffer.left--;
+        continue;
+      }
+      // Return the delimiter found
+      sf->buffer.offset++;
+      sf->buffer.left--;
+      return found;
+    }
+  }
+}
+
+// Read name and comment of a record whose '>' or '@' has been consumed.
+static inline void
+readHeader(seqioFile* sf, seqioRecord* record)
+{
+  char delim = readUntilEither(sf, record->name, ' ', '\n');
+  record->name->data[record->name->length] = '\0';
+  if (delim == ' ') {
+    readUntilEither(sf, record->comment, '\n', '\n');
+    record->comment->data[record->comment->length] = '\0';
+  }
+}
+
+// Consume the rest of the current line including its line break.
+static inline void
+skipLine(seqioFile* sf)
+{
+  size_t readSize;
+  while ((readSize = readDataToBuffer(sf)) > 0) {
+    char* buff = sf->buffer.data + sf->buffer.offset;
+    char* lineEnd = memchr(buff, '\n', readSize);
+    size_t skip = lineEnd ? (size_t)(lineEnd - buff) + 1 : readSize;
+    sf->buffer.offset += skip;
+    sf->buffer.left -= skip;
+    if (lineEnd) {
+      return;
+    }
+  }
+}
+
+static inline seqioRecord*
+readFastaFields(seqioFile* sf, seqioRecord* record)
+{
+  readHeader(sf, record);
+  readUntil(sf, record->sequence, '>', READ_STATUS_NAME);
+  record->sequence->data[record->sequence->length] = '\0';
+  sf->record = (seqioRecord*)record;
+  seqioTell(sf);
+  return record;
+}
+
+static inline seqioRecord*
+readFastqFields(seqioFile* sf, seqioRecord* record)
+{
+  readHeader(sf, record);
+  readUntil(sf, record->sequence, '+', READ_STATUS_ADD);
+  record->sequence->data[record->sequence->length] = '\0';
+  skipLine(sf);
+  readUntil(sf, record->quality, '@', READ_STATUS_NAME);
+  record->quality->data[record->quality->length] = '\0';
+  sf->record = (seqioRecord*)record;
+  seqioTell(sf);
+  return record;
+}
+
+// Zero-copy parsing works on a buffer which holds the whole input, so
+// records are sliced out of it directly instead of being copied.
+
+// Return the end of the line starting at p without its line break and
+// store the start of the following line in next.
+static inline char*
+viewLineEnd(char* p, char* end, char** next)
+{
+  char* stop = memchr(p, '\n', end - p);
+  if (stop == NULL) {
+    stop = end;
+    *next = end;
+  } else {
+    *next = stop + 1;
+  }
+  if (stop > p && stop[-1] == '\r') {
+    stop--;
+  }
+  return stop;
+}
+
+static seqioRecord*
+recordNew(seqioAllocator* allocator, seqioRecordType type, size_t capacity)
+{
+  seqioRecord* record =
+      (seqioRecord*)allocatorAlloc(allocator, sizeof(seqioRecord));
+  if (record == NULL) {
+    return NULL;
+  }
+  record->type = type;
+  record->allocator = allocator;
+  record->name = seqioStringNewFrom(allocator, capacity);
+  record->comment = seqioStringNewFrom(allocator, capacity);
+  record->sequence = seqioStringNewFrom(allocator, capacity);
+  record->quality = seqioStringNewFrom(allocator, capacity);
+  return record;
+}
+
+static inline char*
+viewHeader(seqioRecord* record, char* p, char* end)
+{
+  char* next;
+  char* stop = viewLineEnd(p, end, &next);
+  char* space = memchr(p, ' ', stop - p);
+  if (space == NULL) {
+    seqioStringView(record->name, p, stop - p);
+    seqioStringView(record->comment, seqioEmptyString, 0);
+  } else {
+    seqioStringView(record->name, p, space - p);
+    seqioStringView(record->comment, space + 1, stop - space - 1);
+  }
+  return next;
+}
+
+// Collect lines until one starts with untilChar. A field on a single line
+// stays a view, only fields spread over several lines are copied into
+// backing so that the line breaks can be dropped.
+static inline char*
+viewLines(seqioString* s,
+          seqioString* backing,
+          char* p,
+          char* end,
+          char untilChar)
+{
+  char* first = NULL;
+  size_t firstLength = 0;
+  bool copied = false;
+  char* next;
+  while (p < end && *p != untilChar) {
+    char* stop = viewLineEnd(p, end, &next);
+    size_t length = stop - p;
+    if (length) {
+      if (first == NULL) {
+        first = p;
+        firstLength = length;
+      } else {
+        if (!copied) {
+          seqioStringClear(backing);
+          seqioStringAppend(backing, first, firstLength);
+          copied = true;
+        }
+        seqioStringAppend(backing, p, length);
+      }
+    }
+    p = next;
+  }
+  if (copied) {
+    seqioStringView(s, backing->data, backing->length);
+  } else if (first) {
+    seqioStringView(s, first, firstLength);
+  } else {
+    seqioStringView(s, seqioEmptyString, 0);
+  }
+  return p;
+}
+
+// Quality lines may start with '@' or '+', so they are collected until they
+// cover the sequence instead of until the next record marker.
+static inline char*
+viewQuality(seqioString* s,
+            seqioString* backing,
+            char* p,
+            char* end,
+            size_t length)
+{
+  char* next;
+  char* stop = viewLineEnd(p, end, &next);
+  if (next >= end || (size_t)(stop - p) >= length) {
+    seqioStringView(s, p, stop - p);
+    return next;
+  }
+  seqioStringClear(backing);
+  seqioStringAppend(backing, p, stop - p);
+  p = next;
+  while (p < end && backing->length < length) {
+    stop = viewLineEnd(p, end, &next);
+    seqioStringAppend(backing, p, stop - p);
+    p = next;
+  }
+  seqioStringView(s, backing->data, backing->length);
+  return p;
+}
+
+static inline seqioRecord*
+viewEOF(seqioFile* sf, seqioRecord* record)
+{
+  sf->buffer.offset += sf->buffer.left;
+  sf->buffer.left = 0;
+  if (sf->pravite.options->freeRecordOnEOF) {
+    seqioFreeRecord(record);
+  }
+  sf->record = NULL;
+  sf->fileStats.fileOffset = sf->fileStats.fileSize;
+  return NULL;
+}
+
+static inline seqioRecord*
+viewFinish(seqioFile* sf, seqioRecord* record, char* p)
+{
+  size_t used = p - (sf->buffer.data + sf->buffer.offset);
+  sf->buffer.offset += used;
+  sf->buffer.left -= used;
+  sf->pravite.state = READ_STATUS_NONE;
+  sf->record = record;
+  seqioTell(sf);
+  return record;
+}
+
+// Slice the record starting at p, which points at its '>', and return the
+// start of the next one.
+static inline char*
+viewFastaRecord(seqioRecord* record, seqioString* backing, char* p, char* end)
+{
+  p = viewHeader(record, p + 1, end);
+  return viewLines(record->sequence, backing, p, end, '>');
+}
+
+static inline char*
+viewFastqRecord(seqioRecord* record,
+                seqioString* sequenceBacking,
+                seqioString* qualityBacking,
+                char* p,
+                char* end)
+{
+  p = viewHeader(record, p + 1, end);
+  p = viewLines(record->sequence, sequenceBacking, p, end, '+');
+  // skip the '+' line
+  viewLineEnd(p, end, &p);
+  if (p < end) {
+    p = viewQuality(record->quality, qualityBacking, p, end,
+                    record->sequence->length);
+  } else {
+    seqioStringView(record->quality, seqioEmptyString, 0);
+  }
+  return p;
+}
+
+static seqioRecord*
+viewFasta(seqioFile* sf, seqioRecord* record)
+{
+  char* p = sf->buffer.data + sf->buffer.offset;
+  char* end = p + sf->buffer.left;
+  p = memchr(p, '>', end - p);
+  if (p == NULL) {
+    return viewEOF(sf, record);
+  }
+  if (record == NULL) {
+    record = recordNew(sf->pravite.options->allocator,
+                       seqioRecordTypeFasta, 0);
+    if (record == NULL) {
+      return NULL;
+    }
+  }
+  record->type = seqioRecordTypeFasta;
+  p = viewFastaRecord(record, sf->mapping.sequence, p, end);
+  return viewFinish(sf, record, p);
+}
+
+static seqioRecord*
+viewFastq(seqioFile* sf, seqioRecord* record)
+{
+  char* p = sf->buffer.data + sf->buffer.offset;
+  char* end = p + sf->buffer.left;
+  p = memchr(p, '@', end - p);
+  if (p == NULL) {
+    return viewEOF(sf, record);
+  }
+  if (record == NULL) {
+    record = recordNew(sf->pravite.options->allocator,
+                       seqioRecordTypeFastq, 0);
+    if (record == NULL) {
+      return NULL;
+    }
+  }
+  record->type = seqioRecordTypeFastq;
+  p = viewFastqRecord(record, sf->mapping.sequence, sf->mapping.quality, p,
+                      end);
+  return viewFinish(sf, record, p);
+}
+
+// Copy up to size bases of the sequence being streamed into out, or drop
+// them when out is NULL. Like readUntil it stops after the '>' of the next
+// record, which can only show up at the start of a line.
+static size_t
+streamSequence(seqioFile* sf, char* out, size_t size)
+{
+  size_t n = 0;
+  while (n < size) {
+    size_t readSize = readDataToBuffer(sf);
+    if (readSize == 0) {
+      sf->pravite.state = READ_STATUS_NONE;
+      break;
+    }
+    char* buff = sf->buffer.data + sf->buffer.offset;
+    if (buff[0] == '>') {
+      forwardBufferOne(sf);
+      sf->pravite.state = READ_STATUS_NAME;
+      break;
+    }
+    size_t i = scanAny3(buff, readSize, '\n', '\r', '\n');
+    if (i == 0) {
+      forwardBufferOne(sf);
+      continue;
+    }
+    if (i > size - n) {
+      i = size - n;
+    }
+    if (out) {
+      memcpy(out + n, buff, i);
+    }
+    n += i;
+    sf->buffer.offset += i;
+    sf->buffer.left -= i;
+  }
+  return n;
+}
+
+seqioRecord*
+seqioReadFasta(seqioFile* sf, seqioRecord* record)
+{
+  if (sf->pravite.state == READ_STATUS_SEQUENCE) {
+    // the caller stopped streaming a sequence part way, drop the rest
+    streamSequence(sf, NULL, SIZE_MAX);
+  }
+  if (sf->pravite.isEOF && sf->buffer.left == 0) {
+    if (sf->pravite.options->freeRecordOnEOF) {
+      seqioFreeRecord(record);
+    }
+    sf->record = NULL;
+    sf->fileStats.fileOffset = sf->fileStats.fileSize;
+    return NULL;
+  }
+  ensureFastaRecord(sf, "Cannot read fasta record from a fastq file.");
+  if (sf->mapping.data) {
+    if (sf->pravite.state == READ_STATUS_NAME) {
+      // streaming stopped right after this '>'
+      backwardBufferOne(sf);
+    }
+    return viewFasta(sf, record);
+  }
+  if (record == NULL) {
+    record = recordNew(sf->pravite.options->allocator, seqioRecordTypeFasta,
+                       256);
+    if (record == NULL) {
+      return NULL;
+    }
+  } else {
+    record->type = seqioRecordTypeFasta;
+    seqioStringClear(record->name);
+    seqioStringClear(record->comment);
+    seqioStringClear(record->sequence);
+  }
+  readStatus status = sf->pravite.state;
+  int c;
+  while (1) {
+    size_t readSize = readDataToBuffer(sf);
+    if (readSize == 0) {
+      break;
+    }
+    char* buff = sf->buffer.data + sf->buffer.offset;
+    for (size_t i = 0; i < readSize; i++) {
+      c = buff[i];
+      forwardBufferOne(sf);
+      if (c == '\r' || c == '\t') {
+        continue;
+      }
+      switch (status) {
+      case READ_STATUS_NONE: {
+        if (c == '>') {
+          return readFastaFields(sf, record);
+        }
+        break;
+      }
+      case READ_STATUS_NAME: {
+        // the previous record stopped right after this '>'
+        backwardBufferOne(sf);
+        return readFastaFields(sf, record);
+      }
+      case READ_STATUS_COMMENT: {
+        // This state should not be reached with optimized reading
+        if (c == '\n') {
+          status = READ_STATUS_SEQUENCE;
+          record->comment->data[record->comment->length] = '\0';
+        } else {
+          seqioStringAppendChar(record->comment, c);
+        }
+        break;
+      }
+      case READ_STATUS_SEQUENCE: {
+        // back to the first char of this line
+        backwardBufferOne(sf);
+        readUntil(sf, record->sequence, '>', READ_STATUS_NAME);
+        record->sequence->data[record->sequence->length] = '\0';
+        sf->record = (seqioRecord*)record;
+        seqioTell(sf);
+        return record;
+      }
+      default: {
+        break;
+      }
+      }
+    }
+  }
+  sf->record = (seqioRecord*)record;
+  record->sequence->data[record->sequence->length] = '\0';
+  seqioTell(sf);
+  return record;
+}
+
+seqioRecord*
+seqioReadFastq(seqioFile* sf, seqioRecord* record)
+{
+  if (sf->pravite.isEOF && sf->buffer.left == 0) {
+    if (sf->pravite.options->freeRecordOnEOF) {
+      seqioFreeRecord(record);
+    }
+    sf->record = NULL;
+    sf->fileStats.fileOffset = sf->fileStats.fileSize;
+    return NULL;
+  }
+  ensureFastqRecord(sf, "Cannot read fastq record from a fasta file.");
+  if (sf->mapping.data) {
+    return viewFastq(sf, record);
+  }
+  if (record == NULL) {
+    record = recordNew(sf->pravite.options->allocator, seqioRecordTypeFastq,
+                       256);
+    if (record == NULL) {
+      return NULL;
+    }
+  } else {
+    record->type = seqioRecordTypeFastq;
+    seqioStringClear(record->name);
+    seqioStringClear(record->comment);
+    seqioStringClear(record->sequence);
+    seqioStringClear(record->quality);
+  }
+  readStatus status = sf->pravite.state;
+  int c;
+  while (1) {
+    size_t readSize = readDataToBuffer(sf);
+    if (readSize == 0) {
+      break;
+    }
+    char* buff = sf->buffer.data + sf->buffer.offset;
+    for (size_t i = 0; i < readSize; i++) {
+      c = buff[i];
+      forwardBufferOne(sf);
+      if (c == '\r') {
+        continue;
+      }
+      switch (status) {
+      case READ_STATUS_NONE: {
+        if (c == '@') {
+          return readFastqFields(sf, record);
+        }
+        break;
+      }
+      case READ_STATUS_NAME: {
+        // the previous record stopped right after this '@'
+        backwardBufferOne(sf);
+        return readFastqFields(sf, record);
+      }
+      case READ_STATUS_COMMENT: {
+        // Fallback for character-by-character reading
+        if (c == '\n') {
+          status = READ_STATUS_SEQUENCE;
+          record->comment->data[record->comment->length] = '\0';
+        } else {
+          seqioStringAppendChar(record->comment, c);
+        }
+        break;
+      }
+      case READ_STATUS_SEQUENCE: {
+        backwardBufferOne(sf);
+        readUntil(sf, record->sequence, '+', READ_STATUS_ADD);
+        record->sequence->data[record->sequence->length] = '\0';
+        status = READ_STATUS_ADD;
+        backwardBufferOne(sf); // back to '+' line
+        // update i, readSize and buff for next loop
+        i = 0;
+        buff = sf->buffer.data + sf->buffer.offset;
+        readSize = sf->buffer.left;
+        break;
+      }
+      case READ_STATUS_ADD: {
+        if (c != '\n') {
+          skipLine(sf);
+        }
+        readUntil(sf, record->quality, '@', READ_STATUS_NAME);
+        record->quality->data[record->quality->length] = '\0';
+        sf->record = (seqioRecord*)record;
+        seqioTell(sf);
+        return record;
+      }
+      case READ_STATUS_QUALITY: {
+        backwardBufferOne(sf);
+        readUntil(sf, record->quality, '@', READ_STATUS_NAME);
+        record->quality->data[record->quality->length] = '\0';
+        sf->record = (seqioRecord*)record;
+        seqioTell(sf);
+        return record;
+      }
+      default: {
+        break;
+      }
+      }
+    }
+  }
+  sf->record = (seqioRecord*)record;
+  record->quality->data[record->quality->length] = '\0';
+  seqioTell(sf);
+  return record;
+}
+
+seqioRecord*
+seqioRead(seqioFile* sf, seqioRecord* record)
+{
+  if (sf->pravite.isEOF && sf->buffer.left == 0) {
+    if (sf->pravite.options->freeRecordOnEOF) {
+      seqioFreeRecord(record);
+    }
+    sf->record = NULL;
+    return NULL;
+  }
+  if (sf->pravite.type == seqioRecordTypeFasta) {
+    return seqioReadFasta(sf, record);
+  } else if (sf->pravite.type == seqioRecordTypeFastq) {
+    return seqioReadFastq(sf, record);
+  } else {
+    return NULL;
+  }
+}
+
+seqioRecord*
+seqioReadHeader(seqioFile* sf, seqioRecord* record)
+{
+  if (sf->pravite.state == READ_STATUS_SEQUENCE) {
+    streamSequence(sf, NULL, SIZE_MAX);
+  }
+  if (sf->pravite.isEOF && sf->buffer.left == 0) {
+    if (sf->pravite.options->freeRecordOnEOF) {
+      seqioFreeRecord(record);
+    }
+    sf->record = NULL;
+    sf->fileStats.fileOffset = sf->fileStats.fileSize;
+    return NULL;
+  }
+  ensureFastaRecord(sf, "Cannot stream sequence from a fastq file.");
+  if (sf->pravite.state != READ_STATUS_NAME) {
+    // find the '>' of the next record
+    size_t readSize;
+    while ((readSize = readDataToBuffer(sf)) > 0) {
+      char* buff = sf->buffer.data + sf->buffer.offset;
+      char* p = memchr(buff, '>', readSize);
+      size_t skip = p ? (size_t)(p - buff) + 1 : readSize;
+      sf->buffer.offset += skip;
+      sf->buffer.left -= skip;
+      if (p) {
+        break;
+      }
+    }
+    if (readSize == 0) {
+      if (sf->pravite.options->freeRecordOnEOF) {
+        seqioFreeRecord(record);
+      }
+      sf->record = NULL;
+      sf->fileStats.fileOffset = sf->fileStats.fileSize;
+      return NULL;
+    }
+  }
+  if (record == NULL) {
+    record = recordNew(sf->pravite.options->allocator, seqioRecordTypeFasta,
+                       256);
+    if (record == NULL) {
+      return NULL;
+    }
+  } else {
+    seqioStringClear(record->name);
+    seqioStringClear(record->comment);
+    seqioStringClear(record->sequence);
+  }
+  record->type = seqioRecordTypeFasta;
+  readHeader(sf, record);
+  sf->pravite.state = READ_STATUS_SEQUENCE;
+  sf->record = record;
+  seqioTell(sf);
+  return record;
+}
+
+size_t
+seqioReadSequence(seqioFile* sf, char* buffer, size_t size)
+{
+  if (sf->pravite.state != READ_STATUS_SEQUENCE) {
+    return 0;
+  }
+  size_t n = streamSequence(sf, buffer, size);
+  seqioTell(sf);
+  return n;
+}
+
+seqioBatch*
+seqioBatchNewFrom(seqioAllocator* allocator, size_t records, size_t bytes)
+{
+  seqioBatch* batch =
+      (seqioBatch*)allocatorAlloc(allocator, sizeof(seqioBatch));
+  if (batch == NULL) {
+    return NULL;
+  }
+  memset(batch, 0, sizeof(seqioBatch));
+  batch->allocator = allocator;
+  batch->type = seqioRecordTypeUnknown;
+  batch->capacity = records ? records : 1;
+  batch->dataCapacity = bytes ? bytes : seqioDefaultBufferSize;
+  size_t slices = sizeof(seqioSlice) * batch->capacity;
+  batch->data = (char*)allocatorAlloc(allocator, batch->dataCapacity);
+  batch->name = (seqioSlice*)allocatorAlloc(allocator, slices);
+  batch->comment = (seqioSlice*)allocatorAlloc(allocator, slices);
+  batch->sequence = (seqioSlice*)allocatorAlloc(allocator, slices);
+  batch->quality = (seqioSlice*)allocatorAlloc(allocator, slices);
+  if (batch->data == NULL || batch->name == NULL || batch->comment == NULL
+      || batch->sequence == NULL || batch->quality == NULL) {
+    seqioBatchFree(batch);
+    return NULL;
+  }
+  return batch;
+}
+
+seqioBatch*
+seqioBatchNew(size_t records, size_t bytes)
+{
+  return seqioBatchNewFrom(NULL, records, bytes);
+}
+
+void
+seqioBatchFree(seqioBatch* batch)
+{
+  if (batch == NULL) {
+    return;
+  }
+  seqioAllocator* allocator = batch->allocator;
+  size_t slices = sizeof(seqioSlice) * batch->capacity;
+  if (batch->data) {
+    allocatorRelease(allocator, batch->data, batch->dataCapacity);
+  }
+  seqioSlice* arrays[4] = { batch->name, batch->comment, batch->sequence,
+                            batch->quality };
+  for (int i = 0; i < 4; i++) {
+    if (arrays[i]) {
+      allocatorRelease(allocator, arrays[i], slices);
+    }
+  }
+  allocatorRelease(allocator, batch, sizeof(seqioBatch));
+}
+
+void
+seqioBatchClear(seqioBatch* batch)
+{
+  batch->count = 0;
+  batch->size = 0;
+}
+
+static inline bool
+batchReserve(seqioBatch* batch, size_t bytes)
+{
+  if (batch->count == batch->capacity) {
+    size_t capacity = batch->capacity * 2;
+    seqioSlice** arrays[4] = { &batch->name, &batch->comment,
+                               &batch->sequence, &batch->quality };
+    for (int i = 0; i < 4; i++) {
+      seqioSlice* slices = (seqioSlice*)allocatorResize(
+          batch->allocator, *arrays[i], sizeof(seqioSlice) * batch->capacity,
+          sizeof(seqioSlice) * capacity);
+      if (slices == NULL) {
+        return false;
+      }
+      *arrays[i] = slices;
+    }
+    batch->capacity = capacity;
+  }
+  if (batch->size + bytes > batch->dataCapacity) {
+    size_t dataCapacity = batch->dataCapacity * 2;
+    while (batch->size + bytes > dataCapacity) {
+      dataCapacity *= 2;
+    }
+    char* data = (char*)allocatorResize(batch->allocator, batch->data,
+                                        batch->dataCapacity, dataCapacity);
+    if (data == NULL) {
+      return false;
+    }
+    batch->data = data;
+    batch->dataCapacity = dataCapacity;
+  }
+  return true;
+}
+
+static inline seqioSlice
+batchAppend(seqioBatch* batch, seqioString* s)
+{
+  seqioSlice slice = { batch->size, 0 };
+  if (s != NULL) {
+    memcpy(batch->data + batch->size, s->data, s->length);
+    slice.length = s->length;
+  }
+  batch->size += slice.length;
+  batch->data[batch->size++] = '\0';
+  return slice;
+}
+
+// Copy a record to the end of the batch, slices of earlier records stay
+// valid when the arena grows since they are offsets.
+bool
+seqioBatchPush(seqioBatch* batch, seqioRecord* record)
+{
+  size_t bytes = record->name->length + record->sequence->length + 4;
+  if (record->comment != NULL) {
+    bytes += record->comment->length;
+  }
+  if (record->quality != NULL) {
+    bytes += record->quality->length;
+  }
+  if (!batchReserve(batch, bytes)) {
+    return false;
+  }
+  size_t i = batch->count;
+  batch->name[i] = batchAppend(batch, record->name);
+  batch->comment[i] = batchAppend(batch, record->comment);
+  batch->sequence[i] = batchAppend(batch, record->sequence);
+  batch->quality[i] = batchAppend(batch, record->quality);
+  batch->type = record->type;
+  batch->count++;
+  return true;
+}
+
+// Refill the batch with up to maxRecords records, or fewer once the arena
+// holds maxBytes, a limit of 0 means no limit. Returns the number of
+// records read, 0 at the end of the file.
+size_t
+seqioReadBatch(seqioFile* sf,
+               seqioBatch* batch,
+               size_t maxRecords,
+               size_t maxBytes)
+{
+  seqioBatchClear(batch);
+  batch->type = sf->pravite.type;
+  if (sf->pravite.batchRecord == NULL) {
+    // the scratch record outlives any arena the caller resets between
+    // batches, so it does not come from the file's allocator
+    sf->pravite.batchRecord =
+        recordNew(NULL, sf->pravite.type, sf->mapping.data ? 0 : 256);
+  }
+  while ((maxRecords == 0 || batch->count < maxRecords)
+         && (maxBytes == 0 || batch->size < maxBytes)) {
+    seqioRecord* record = seqioRead(sf, sf->pravite.batchRecord);
+    if (record == NULL) {
+      if (sf->pravite.options->freeRecordOnEOF) {
+        // seqioRead has released it
+        sf->pravite.batchRecord = NULL;
+      }
+      break;
+    }
+    sf->pravite.batchRecord = record;
+    if (!seqioBatchPush(batch, record)) {
+      fprintf(stderr, "Failed to grow the record batch.\n");
+      exit(1);
+    }
+  }
+  // the scratch record is not the caller's, seqioClose frees it separately
+  sf->record = NULL;
+  return batch->count;
+}
+
+// Parallel reading splits a mapped file into chunks of chunkSize bytes. A
+// record belongs to the chunk its marker falls into, so every worker first
+// moves to the first record start inside its chunk and then parses past
+// the chunk end until the record it is in is complete.
+
+static inline char*
+nextLine(char* p, char* end)
+{
+  char* stop = memchr(p, '\n', end - p);
+  return stop ? stop + 1 : end;
+}
+
+// Skip the FASTQ record at p, which points at an '@', the way viewFastqRecord
+// reads it: the quality takes as many bytes as there are bases above the
+// '+' line, however both are wrapped. Return the start of what follows, or
+// NULL if the lines at p cannot be a record. truncated is set when the
+// input ends inside the record.
+static inline char*
+skipFastqRecord(char* p, char* end, bool* truncated)
+{
+  char* next;
+  *truncated = false;
+  viewLineEnd(p, end, &next);
+  p = next;
+  size_t bases = 0;
+  while (p < end && *p != '+') {
+    char* stop = viewLineEnd(p, end, &next);
+    // bases are letters, '*', '-' or '.', a quality line mostly is not
+    for (char* c = p; c < stop; c++) {
+      if (!isalpha((unsigned char)*c) && *c != '*' && *c != '-'
+          && *c != '.') {
+        return NULL;
+      }
+    }
+    bases += stop - p;
+    p = next;
+  }
+  if (p >= end) {
+    *truncated = true;
+    return end;
+  }
+  viewLineEnd(p, end, &p);
+  size_t quality = 0;
+  do {
+    quality += viewLineEnd(p, end, &next) - p;
+    p = next;
+  } while (p < end && quality < bases);
+  if (quality < bases) {
+    *truncated = true;
+    return end;
+  }
+  if (quality != bases) {
+    return NULL;
+  }
+  while (p < end && (*p == '\n' || *p == '\r')) {
+    p++;
+  }
+  return p == end || *p == '@' ? p : NULL;
+}
+
+// A line starting with '@' may be a quality line. It starts a record if it
+// reads as a complete one that ends where another '@' line or the input
+// starts, and the record after it reads as one too.
+static inline bool
+isFastqRecordStart(char* p, char* end)
+{
+  bool truncated;
+  char* next = skipFastqRecord(p, end, &truncated);
+  if (next == NULL || truncated) {
+    return false;
+  }
+  return next == end || skipFastqRecord(next, end, &truncated) != NULL;
+}
+
+// Return the first record start at or after p and before limit, or limit
+// if there is none.
+static inline char*
+syncRecordStart(seqioRecordType type,
+                char* data,
+                char* p,
+                char* limit,
+                char* end)
+{
+  if (p > data && p[-1] != '\n') {
+    p = nextLine(p, end);
+  }
+  while (p < limit) {
+    if (type == seqioRecordTypeFasta && *p == '>') {
+      return p;
+    }
+    if (type == seqioRecordTypeFastq && *p == '@'
+        && isFastqRecordStart(p, end)) {
+      return p;
+    }
+    p = nextLine(p, end);
+  }
+  return limit;
+}
+
+// The type of a mapped file is told by the first record marker in it.
+static inline seqioRecordType
+mappedRecordType(char* data, size_t size)
+{
+  for (size_t i = 0; i < size; i++) {
+    if (data[i] == '>' || data[i] == '@') {
+      return data[i] == '>' ? seqioRecordTypeFasta : seqioRecordTypeFastq;
+    }
+  }
+  return seqioRecordTypeUnknown;
+}
+
+typedef struct {
+  seqioParallelOptions* options;
+  seqioRecordType type;
+  char* data;
+  size_t size;
+  size_t chunkSize;
+  size_t chunkCount;
+  size_t nextChunk;
+  size_t nextDelivery;
+  size_t records;
+  seqioMutex lock;
+  seqioCond turn;
+} parallelReader;
+
+static void*
+parallelReadWorker(void* arg)
+{
+  parallelReader* pr = (parallelReader*)arg;
+  char* end = pr->data + pr->size;
+  seqioBatch* batch = seqioBatchNew(1024, pr->chunkSize + pr->chunkSize / 4);
+  seqioRecord* record = recordNew(NULL, pr->type, 0);
+  seqioString* sequence = seqioStringNew(256);
+  seqioString* quality = seqioStringNew(256);
+  if (batch == NULL || record == NULL) {
+    fprintf(stderr, "Failed to allocate a record batch.\n");
+    exit(1);
+  }
+  while (1) {
+    mutexLock(&pr->lock);
+    size_t chunk = pr->nextChunk++;
+    mutexUnlock(&pr->lock);
+    if (chunk >= pr->chunkCount) {
+      break;
+    }
+    char* chunkEnd = pr->data + chunk * pr->chunkSize + pr->chunkSize;
+    chunkEnd = chunkEnd < end ? chunkEnd : end;
+    char marker = pr->type == seqioRecordTypeFasta ? '>' : '@';
+    char* p = syncRecordStart(pr->type, pr->data,
+                              pr->data + chunk * pr->chunkSize, chunkEnd, end);
+    seqioBatchClear(batch);
+    batch->type = pr->type;
+    while (p < chunkEnd) {
+      if (pr->type == seqioRecordTypeFasta) {
+        p = viewFastaRecord(record, sequence, p, end);
+      } else {
+        p = viewFastqRecord(record, sequence, quality, p, end);
+      }
+      if (!seqioBatchPush(batch, record)) {
+        fprintf(stderr, "Failed to grow the record batch.\n");
+        exit(1);
+      }
+      if (p < chunkEnd && *p != marker) {
+        // blank lines or junk between records
+        p = syncRecordStart(pr->type, pr->data, p, chunkEnd, end);
+      }
+    }
+    if (pr->options->ordered) {
+      mutexLock(&pr->lock);
+      while (pr->nextDelivery != chunk) {
+        condWait(&pr->turn, &pr->lock);
+      }
+      mutexUnlock(&pr->lock);
+    }
+    if (batch->count) {
+      pr->options->callback(batch, pr->options->userData);
+    }
+    mutexLock(&pr->lock);
+    pr->records += batch->count;
+    if (pr->options->ordered) {
+      pr->nextDelivery++;
+      condBroadcast(&pr->turn);
+    }
+    mutexUnlock(&pr->lock);
+  }
+  seqioBatchFree(batch);
+  seqioFreeRecord(record);
+  seqioStringFree(sequence);
+  seqioStringFree(quality);
+  return NULL;
+}
+
+// Input which cannot be mapped is read batch by batch on this thread.
+static inline size_t
+parallelReadSequential(seqioParallelOptions* options, size_t chunkSize)
+{
+  seqioOpenOptions openOptions = {
+    .filename = options->filename,
+    .mode = seqOpenModeRead,
+    .threads = options->threads,
+  };
+  seqioFile* sf = seqioOpen(&openOptions);
+  if (sf == NULL) {
+    return 0;
+  }
+  seqioBatch* batch = seqioBatchNew(1024, chunkSize);
+  if (batch == NULL) {
+    seqioClose(sf);
+    return 0;
+  }
+  size_t records = 0;
+  while (seqioReadBatch(sf, batch, 0, chunkSize) > 0) {
+    options->callback(batch, options->userData);
+    records += batch->count;
+  }
+  seqioBatchFree(batch);
+  seqioClose(sf);
+  return records;
+}
+
+size_t
+seqioParallelRead(seqioParallelOptions* options)
+{
+  checkFileExist(options->filename);
+  size_t chunkSize =
+      options->chunkSize ? options->chunkSize : seqioParallelChunkSize;
+  FILE* fp = fopen(options->filename, "rb");
+  if (fp == NULL) {
+    return 0;
+  }
+  unsigned char magic[2] = { 0 };
+  size_t bytesRead = fread(magic, 1, 2, fp);
+  if (bytesRead == 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+    fclose(fp);
+    return parallelReadSequential(options, chunkSize);
+  }
+  fseek(fp, 0, SEEK_SET);
+  size_t size = 0;
+  char* data = mapFile(fp, &size);
+  fclose(fp);
+  if (data == NULL) {
+    return parallelReadSequential(options, chunkSize);
+  }
+  parallelReader pr;
+  memset(&pr, 0, sizeof(parallelReader));
+  pr.options = options;
+  pr.data = data;
+  pr.size = size;
+  pr.chunkSize = chunkSize;
+  pr.chunkCount = (size + chunkSize - 1) / chunkSize;
+  pr.type = mappedRecordType(data, size);
+  if (pr.type == seqioRecordTypeUnknown) {
+    unmapFile(data, size);
+    return 0;
+  }
+  mutexInit(&pr.lock);
+  condInit(&pr.turn);
+  int threads = options->threads > 1 ? options->threads : 1;
+  seqioThread* workers =
+      (seqioThread*)seqioMalloc(sizeof(seqioThread) * threads);
+  int started = 0;
+  if (workers != NULL) {
+    while (started < threads
+           && threadCreate(&workers[started], parallelReadWorker, &pr)) {
+      started++;
+    }
+  }
+  if (started == 0) {
+    // no thread to spare, do the work here
+    parallelReadWorker(&pr);
+  }
+  for (int i = 0; i < started; i++) {
+    threadJoin(workers[i]);
+  }
+  seqioFree(workers);
+  mutexDestroy(&pr.lock);
+  condDestroy(&pr.turn);
+  unmapFile(data, size);
+  return pr.records;
+}
+
+void
+seqioWriteFasta(seqioFile* sf, seqioRecord* record, seqioWriteOptions* options)
+{
+  ensureWriteable(sf);
+  if (!options) {
+    options = &defaultWriteOptions;
+  }
+  if (sf->pravite.type == seqioRecordTypeUnknown) {
+    sf->pravite.type = seqioRecordTypeFasta;
+  }
+  // write name
+  writeDataToBuffer(sf, ">", 1);
+  writeDataToBuffer(sf, record->name->data, record->name->length);
+  // write comment
+  if (options->includeComment && record->comment->length) {
+    writeDataToBuffer(sf, " ", 1);
+    writeDataToBuffer(sf, record->comment->data, record->comment->length);
+  }
+  writeDataToBuffer(sf, "\n", 1);
+  // write sequence
+  if (options->lineWidth == 0) {
+    writeSequenceToBuffer(sf, record->sequence->data, record->sequence->length,
+                          options->baseCase);
+    writeDataToBuffer(sf, "\n", 1);
+  } else {
+    size_t sequenceLength = record->sequence->length;
+    size_t sequenceOffset = 0;
+    while (sequenceLength) {
+      if (sequenceLength >= options->lineWidth) {
+        writeSequenceToBuffer(sf, record->sequence->data + sequenceOffset,
+                              options->lineWidth, options->baseCase);
+        writeDataToBuffer(sf, "\n", 1);
+        sequenceOffset += options->lineWidth;
+        sequenceLength -= options->lineWidth;
+      } else {
+        writeSequenceToBuffer(sf, record->sequence->data + sequenceOffset,
+                              sequenceLength, options->baseCase);
+        writeDataToBuffer(sf, "\n", 1);
+        break;
+      }
+    }
+  }
+}
+
+void
+seqioWriteFastq(seqioFile* sf, seqioRecord* record, seqioWriteOptions* options)
+{
+  ensureWriteable(sf);
+  if (!options) {
+    options = &defaultWriteOptions;
+  }
+  if (sf->pravite.type == seqioRecordTypeUnknown) {
+    sf->pravite.type = seqioRecordTypeFastq;
+  }
+  // write name
+  writeDataToBuffer(sf, "@", 1);
+  writeDataToBuffer(sf, record->name->data, record->name->length);
+  // write comment
+  if (options->includeComment && record->comment->length) {
+    writeDataToBuffer(sf, " ", 1);
+    writeDataToBuffer(sf, record->comment->data, record->comment->length);
+  }
+  writeDataToBuffer(sf, "\n", 1);
+  // write sequence
+  writeSequenceToBuffer(sf, record->sequence->data, record->sequence->length,
+                        options->baseCase);
+  // write add
+  writeDataToBuffer(sf, "\n+\n", 3);
+  // write quality
+  writeDataToBuffer(sf, record->quality->data, record->quality->length);
+  writeDataToBuffer(sf, "\n", 1);
+}
+
+static inline seqioString
+batchField(seqioBatch* batch, seqioSlice slice)
+{
+  seqioString s = { batch->data + slice.offset, slice.length, 0, NULL };
+  return s;
+}
+
+// Point the strings of a record at record i of a batch.
+static inline void
+batchRecordView(seqioBatch* batch, size_t i, seqioRecord* record)
+{
+  record->type = batch->type;
+  *record->name = batchField(batch, batch->name[i]);
+  *record->comment = batchField(batch, batch->comment[i]);
+  *record->sequence = batchField(batch, batch->sequence[i]);
+  *record->quality = batchField(batch, batch->quality[i]);
+}
+
+static inline void
+writeRecord(seqioFile* sf, seqioRecord* record, seqioWriteOptions* options)
+{
+  if (record->type == seqioRecordTypeFastq) {
+    seqioWriteFastq(sf, record, options);
+  } else {
+    seqioWriteFasta(sf, record, options);
+  }
+}
+
+// Write every record of a batch, as FASTQ if the batch holds FASTQ records
+// and as FASTA otherwise.
+void
+seqioWriteBatch(seqioFile* sf, seqioBatch* batch, seqioWriteOptions* options)
+{
+  seqioString name, comment, sequence, quality;
+  seqioRecord record = { batch->type, &name, &comment, &sequence, &quality,
+                         NULL };
+  for (size_t i = 0; i < batch->count; i++) {
+    batchRecordView(batch, i, &record);
+    writeRecord(sf, &record, options);
+  }
+}
+
+// The pipeline keeps a ring of jobs like the BGZF workers do. The calling
+// thread reads batches into free jobs and writes finished ones in the
+// order they were read, the workers take queued jobs from a shared queue.
+
+#define seqioPipelineJobsPerThread 4
+
+typedef struct {
+  seqioBatch* in;
+  seqioBatch* out;
+  bool done;
+} pipelineJob;
+
+typedef struct {
+  seqioPipelineOptions* options;
+  pipelineJob* jobs;
+  size_t jobCount;
+  size_t queued;
+  size_t picked;
+  bool stop;
+  seqioMutex lock;
+  seqioCond work;
+  seqioCond ready;
+} seqioPipeline;
+
+static inline void
+pipelineProcess(seqioPipeline* pl, pipelineJob* job)
+{
+  seqioBatchClear(job->out);
+  job->out->type = job->in->type;
+  pl->options->callback(job->in, job->out, pl->options->userData);
+}
+
+static void*
+pipelineWorker(void* arg)
+{
+  seqioPipeline* pl = (seqioPipeline*)arg;
+  mutexLock(&pl->lock);
+  while (1) {
+    while (!pl->stop && pl->picked == pl->queued) {
+      condWait(&pl->work, &pl->lock);
+    }
+    if (pl->picked == pl->queued) {
+      break;
+    }
+    pipelineJob* job = &pl->jobs[pl->picked++ % pl->jobCount];
+    mutexUnlock(&pl->lock);
+    pipelineProcess(pl, job);
+    mutexLock(&pl->lock);
+    job->done = true;
+    condSignal(&pl->ready);
+  }
+  mutexUnlock(&pl->lock);
+  return NULL;
+}
+
+// Run the callback over every batch of the reader on a pool of threads and
+// write the results in input order. Returns the number of records written.
+size_t
+seqioPipelineRun(seqioPipelineOptions* options)
+{
+  seqioPipeline pl;
+  memset(&pl, 0, sizeof(seqioPipeline));
+  pl.options = options;
+  int threads = options->threads > 0 ? options->threads : 0;
+  size_t batchRecords = options->batchRecords ? options->batchRecords
+                                              : seqioPipelineBatchRecords;
+  size_t batchBytes =
+      options->batchBytes ? options->batchBytes : seqioPipelineBatchBytes;
+  pl.jobCount = options->queueDepth
+                    ? options->queueDepth
+                    : (size_t)(threads ? threads : 1) * seqioPipelineJobsPerThread;
+  pl.jobs = (pipelineJob*)seqioMalloc(sizeof(pipelineJob) * pl.jobCount);
+  if (pl.jobs == NULL) {
+    fprintf(stderr, "Failed to allocate the pipeline queue.\n");
+    exit(1);
+  }
+  for (size_t i = 0; i < pl.jobCount; i++) {
+    pl.jobs[i].in = seqioBatchNew(batchRecords, batchBytes);
+    pl.jobs[i].out = seqioBatchNew(batchRecords, batchBytes);
+    if (pl.jobs[i].in == NULL || pl.jobs[i].out == NULL) {
+      fprintf(stderr, "Failed to allocate the pipeline queue.\n");
+      exit(1);
+    }
+  }
+  mutexInit(&pl.lock);
+  condInit(&pl.work);
+  condInit(&pl.ready);
+  seqioThread* workers =
+      (seqioThread*)seqioMalloc(sizeof(seqioThread) * (threads ? threads : 1));
+  int started = 0;
+  if (workers != NULL) {
+    while (started < threads
+           && threadCreate(&workers[started], pipelineWorker, &pl)) {
+      started++;
+    }
+  }
+  size_t consumed = 0;
+  size_t written = 0;
+  bool isEOF = false;
+  while (!isEOF || consumed < pl.queued) {
+    pipelineJob* oldest = &pl.jobs[consumed % pl.jobCount];
+    mutexLock(&pl.lock);
+    bool ready = consumed < pl.queued && oldest->done;
+    mutexUnlock(&pl.lock);
+    if (!isEOF && !ready && pl.queued - consumed < pl.jobCount) {
+      // the job is free, no worker touches it until it is queued
+      pipelineJob* job = &pl.jobs[pl.queued % pl.jobCount];
+      if (seqioReadBatch(options->reader, job->in, batchRecords, batchBytes)
+          == 0) {
+        isEOF = true;
+        continue;
+      }
+      job->done = false;
+      if (started == 0) {
+        pipelineProcess(&pl, job);
+        job->done = true;
+      }
+      mutexLock(&pl.lock);
+      pl.queued++;
+      condSignal(&pl.work);
+      mutexUnlock(&pl.lock);
+      continue;
+    }
+    mutexLock(&pl.lock);
+    while (!oldest->done) {
+      condWait(&pl.ready, &pl.lock);
+    }
+    mutexUnlock(&pl.lock);
+    seqioWriteBatch(options->writer, oldest->out, options->writeOptions);
+    written += oldest->out->count;
+    consumed++;
+  }
+  mutexLock(&pl.lock);
+  pl.stop = true;
+  condBroadcast(&pl.work);
+  mutexUnlock(&pl.lock);
+  for (int i = 0; i < started; i++) {
+    threadJoin(workers[i]);
+  }
+  seqioFree(workers);
+  mutexDestroy(&pl.lock);
+  condDestroy(&pl.work);
+  condDestroy(&pl.ready);
+  for (size_t i = 0; i < pl.jobCount; i++) {
+    seqioBatchFree(pl.jobs[i].in);
+    seqioBatchFree(pl.jobs[i].out);
+  }
+  seqioFree(pl.jobs);
+  return written;
+}
+
+// A paired file reads each mate file on its own thread into a small ring
+// of batches. Both threads read the same number of records per batch, so
+// batch i of one file holds the mates of batch i of the other.
+
+#define seqioPairedBatchRecords 1024
+#define seqioPairedSlots 4
+
+typedef struct {
+  seqioPairedFile* pf;
+  seqioFile* sf;
+  seqioBatch* batches[seqioPairedSlots];
+  size_t produced;
+  size_t consumed;
+  bool isEOF;
+  bool holding;
+  seqioThread thread;
+  bool running;
+} pairedMate;
+
+struct seqioPairedFile {
+  pairedMate mates[2];
+  bool stop;
+  seqioMutex lock;
+  seqioCond changed;
+  seqioBatch* current[2];
+  size_t index;
+  seqioString fields[2][4];
+  seqioRecord records[2];
+};
+
+static void*
+pairedReadWorker(void* arg)
+{
+  pairedMate* mate = (pairedMate*)arg;
+  seqioPairedFile* pf = mate->pf;
+  mutexLock(&pf->lock);
+  while (1) {
+    while (!pf->stop && mate->produced - mate->consumed == seqioPairedSlots) {
+      condWait(&pf->changed, &pf->lock);
+    }
+    if (pf->stop) {
+      break;
+    }
+    // the slot is neither queued nor held by the reader
+    seqioBatch* batch = mate->batches[mate->produced % seqioPairedSlots];
+    mutexUnlock(&pf->lock);
+    size_t count = seqioReadBatch(mate->sf, batch, seqioPairedBatchRecords, 0);
+    mutexLock(&pf->lock);
+    if (count == 0) {
+      mate->isEOF = true;
+      condBroadcast(&pf->changed);
+      break;
+    }
+    mate->produced++;
+    condBroadcast(&pf->changed);
+  }
+  mutexUnlock(&pf->lock);
+  return NULL;
+}
+
+// Release the batch held from a mate file and take the next one, NULL at
+// the end of the file.
+static inline seqioBatch*
+pairedNextBatch(seqioPairedFile* pf, pairedMate* mate)
+{
+  if (!mate->running) {
+    seqioBatch* batch = mate->batches[0];
+    return seqioReadBatch(mate->sf, batch, seqioPairedBatchRecords, 0)
+               ? batch
+               : NULL;
+  }
+  mutexLock(&pf->lock);
+  if (mate->holding) {
+    mate->consumed++;
+    mate->holding = false;
+    condBroadcast(&pf->changed);
+  }
+  while (mate->produced == mate->consumed && !mate->isEOF) {
+    condWait(&pf->changed, &pf->lock);
+  }
+  seqioBatch* batch = NULL;
+  if (mate->produced != mate->consumed) {
+    batch = mate->batches[mate->consumed % seqioPairedSlots];
+    mate->holding = true;
+  }
+  mutexUnlock(&pf->lock);
+  return batch;
+}
+
+// Length of a read name without its /1 or /2 suffix.
+static inline size_t
+pairedNameLength(seqioString* name)
+{
+  size_t length = name->length;
+  if (length >= 2 && name->data[length - 2] == '/'
+      && (name->data[length - 1] == '1' || name->data[length - 1] == '2')) {
+    length -= 2;
+  }
+  return length;
+}
+
+static inline void
+pairedCheckNames(seqioString* name1, seqioString* name2)
+{
+  size_t length = pairedNameLength(name1);
+  if (length != pairedNameLength(name2)
+      || memcmp(name1->data, name2->data, length) != 0) {
+    fprintf(stderr, "Read names do not match: %.*s and %.*s\n",
+            (int)name1->length, name1->data, (int)name2->length, name2->data);
+    exit(1);
+  }
+}
+
+static inline void
+pairedCheckBatchNames(seqioBatch* batch1, seqioBatch* batch2, size_t i)
+{
+  seqioString name1 = batchField(batch1, batch1->name[i]);
+  seqioString name2 = batchField(batch2, batch2->name[i]);
+  pairedCheckNames(&name1, &name2);
+}
+
+static inline size_t
+pairedNext(seqioPairedFile* pf)
+{
+  pf->current[0] = pairedNextBatch(pf, &pf->mates[0]);
+  pf->current[1] = pairedNextBatch(pf, &pf->mates[1]);
+  pf->index = 0;
+  if (pf->current[0] == NULL && pf->current[1] == NULL) {
+    return 0;
+  }
+  if (pf->current[0] == NULL || pf->current[1] == NULL
+      || pf->current[0]->count != pf->current[1]->count) {
+    fprintf(stderr, "Paired files hold different numbers of records.\n");
+    exit(1);
+  }
+  return pf->current[0]->count;
+}
+
+seqioPairedFile*
+seqioPairedOpen(seqioOpenOptions* options1, seqioOpenOptions* options2)
+{
+  if (options1->mode != seqOpenModeRead || options2->mode != seqOpenModeRead) {
+    fprintf(stderr, "Paired files can only be opened for reading.\n");
+    exit(1);
+  }
+  seqioPairedFile* pf = (seqioPairedFile*)seqioMalloc(sizeof(seqioPairedFile));
+  if (pf == NULL) {
+    return NULL;
+  }
+  memset(pf, 0, sizeof(seqioPairedFile));
+  mutexInit(&pf->lock);
+  condInit(&pf->changed);
+  seqioOpenOptions* options[2] = { options1, options2 };
+  for (int m = 0; m < 2; m++) {
+    pairedMate* mate = &pf->mates[m];
+    mate->pf = pf;
+    mate->sf = seqioOpen(options[m]);
+    if (mate->sf == NULL) {
+      seqioPairedClose(pf);
+      return NULL;
+    }
+    for (int i = 0; i < seqioPairedSlots; i++) {
+      mate->batches[i] = seqioBatchNew(seqioPairedBatchRecords, 0);
+      if (mate->batches[i] == NULL) {
+        seqioPairedClose(pf);
+        return NULL;
+      }
+    }
+    for (int f = 0; f < 4; f++) {
+      pf->fields[m][f].data = seqioEmptyString;
+    }
+    pf->records[m].name = &pf->fields[m][0];
+    pf->records[m].comment = &pf->fields[m][1];
+    pf->records[m].sequence = &pf->fields[m][2];
+    pf->records[m].quality = &pf->fields[m][3];
+  }
+  for (int m = 0; m < 2; m++) {
+    // without a thread the mate is read when its batch is needed
+    pf->mates[m].running =
+        threadCreate(&pf->mates[m].thread, pairedReadWorker, &pf->mates[m]);
+  }
+  return pf;
+}
+
+void
+seqioPairedClose(seqioPairedFile* pf)
+{
+  if (pf == NULL) {
+    return;
+  }
+  mutexLock(&pf->lock);
+  pf->stop = true;
+  condBroadcast(&pf->changed);
+  mutexUnlock(&pf->lock);
+  for (int m = 0; m < 2; m++) {
+    pairedMate* mate = &pf->mates[m];
+    if (mate->running) {
+      threadJoin(mate->thread);
+    }
+    for (int i = 0; i < seqioPairedSlots; i++) {
+      seqioBatchFree(mate->batches[i]);
+    }
+    if (mate->sf != NULL) {
+      seqioClose(mate->sf);
+    }
+  }
+  mutexDestroy(&pf->lock);
+  condDestroy(&pf->changed);
+  seqioFree(pf);
+}
+
+// Read the next pair of mates. The records belong to the paired file and
+// stay valid until the next read. Returns false at the end of the files.
+bool
+seqioPairedRead(seqioPairedFile* pf,
+                seqioRecord** record1,
+                seqioRecord** record2)
+{
+  if (pf->current[0] == NULL || pf->index == pf->current[0]->count) {
+    if (pairedNext(pf) == 0) {
+      return false;
+    }
+  }
+  size_t i = pf->index++;
+  pairedCheckBatchNames(pf->current[0], pf->current[1], i);
+  batchRecordView(pf->current[0], i, &pf->records[0]);
+  batchRecordView(pf->current[1], i, &pf->records[1]);
+  *record1 = &pf->records[0];
+  *record2 = &pf->records[1];
+  return true;
+}
+
+// Hand out the next pair of batches, record i of one batch is the mate of
+// record i of the other. The batches belong to the paired file and stay
+// valid until the next read, do not mix this with seqioPairedRead.
+// Returns the number of pairs, 0 at the end of the files.
+size_t
+seqioPairedReadBatch(seqioPairedFile* pf,
+                     seqioBatch** batch1,
+                     seqioBatch** batch2)
+{
+  size_t count = pairedNext(pf);
+  for (size_t i = 0; i < count; i++) {
+    pairedCheckBatchNames(pf->current[0], pf->current[1], i);
+  }
+  *batch1 = pf->current[0];
+  *batch2 = pf->current[1];
+  return count;
+}
+
+// Read the next pair from an interleaved file, records are reused the way
+// seqioRead reuses them. Returns false at the end of the file.
+bool
+seqioReadPair(seqioFile* sf, seqioRecord** record1, seqioRecord** record2)
+{
+  seqioRecord* record = seqioRead(sf, *record1);
+  if (record == NULL) {
+    if (sf->pravite.options->freeRecordOnEOF) {
+      // seqioRead has released the first record
+      *record1 = NULL;
+      seqioFreeRecord(*record2);
+      *record2 = NULL;
+    }
+    return false;
+  }
+  *record1 = record;
+  if (sf->mapping.data) {
+    // a wrapped field of the first mate is joined in the mapping's buffers,
+    // join the second mate's in the other pair so both stay valid
+    seqioString* sequence = sf->mapping.sequence;
+    seqioString* quality = sf->mapping.quality;
+    sf->mapping.sequence = sf->mapping.mateSequence;
+    sf->mapping.quality = sf->mapping.mateQuality;
+    sf->mapping.mateSequence = sequence;
+    sf->mapping.mateQuality = quality;
+  }
+  *record2 = seqioRead(sf, *record2);
+  if (*record2 == NULL) {
+    seqioString* name = (*record1)->name;
+    fprintf(stderr, "Interleaved file ends with an unpaired record: %.*s\n",
+            (int)name->length, name->data);
+    exit(1);
+  }
+  pairedCheckNames((*record1)->name, (*record2)->name);
+  return true;
+}
+
+void
+seqioWritePair(seqioFile* sf,
+               seqioRecord* record1,
+               seqioRecord* record2,
+               seqioWriteOptions* options)
+{
+  pairedCheckNames(record1->name, record2->name);
+  writeRecord(sf, record1, options);
+  writeRecord(sf, record2, options);
+}
+
+// Write the pairs of a paired file to one interleaved file. Returns the
+// number of pairs written.
+size_t
+seqioInterleave(seqioPairedFile* pf, seqioFile* out, seqioWriteOptions* options)
+{
+  size_t pairs = 0;
+  seqioBatch* batch1;
+  seqioBatch* batch2;
+  size_t count;
+  while ((count = seqioPairedReadBatch(pf, &batch1, &batch2)) > 0) {
+    for (size_t i = 0; i < count; i++) {
+      batchRecordView(batch1, i, &pf->records[0]);
+      batchRecordView(batch2, i, &pf->records[1]);
+      writeRecord(out, &pf->records[0], options);
+      writeRecord(out, &pf->records[1], options);
+    }
+    pairs += count;
+  }
+  return pairs;
+}
+
+// Split an interleaved file into two mate files. Returns the number of
+// pairs written.
+size_t
+seqioDeinterleave(seqioFile* in,
+                  seqioFile* out1,
+                  seqioFile* out2,
+                  seqioWriteOptions* options)
+{
+  size_t pairs = 0;
+  seqioRecord* record1 = NULL;
+  seqioRecord* record2 = NULL;
+  while (seqioReadPair(in, &record1, &record2)) {
+    writeRecord(out1, record1, options);
+    writeRecord(out2, record2, options);
+    pairs++;
+  }
+  if (!in->pravite.options->freeRecordOnEOF) {
+    seqioFreeRecord(record1);
+    seqioFreeRecord(record2);
+  }
+  return pairs;
+}
+
+// A .fai holds one line per sequence: name, length, offset of the first
+// base, bases per line and bytes per line, the same as samtools faidx.
+
+static inline char*
+indexPath(const char* filename, const char* suffix)
+{
+  size_t length = strlen(filename);
+  size_t suffixLength = strlen(suffix);
+  char* path = (char*)seqioMalloc(length + suffixLength + 1);
+  if (path == NULL) {
+    return NULL;
+  }
+  memcpy(path, filename, length);
+  memcpy(path + length, suffix, suffixLength + 1);
+  return path;
+}
+
+static inline seqioIndexEntry*
+indexAddEntry(seqioIndex* index, const char* name, size_t nameLength)
+{
+  if (index->count == index->capacity) {
+    size_t capacity = index->capacity ? index->capacity * 2 : 64;
+    seqioIndexEntry* entries = (seqioIndexEntry*)seqioRealloc(
+        index->entries, sizeof(seqioIndexEntry) * capacity);
+    if (entries == NULL) {
+      fprintf(stderr, "Failed to grow the index.\n");
+      exit(1);
+    }
+    index->entries = entries;
+    index->capacity = capacity;
+  }
+  seqioIndexEntry* entry = &index->entries[index->count++];
+  memset(entry, 0, sizeof(seqioIndexEntry));
+  entry->name = (char*)seqioMalloc(nameLength + 1);
+  if (entry->name == NULL) {
+    fprintf(stderr, "Failed to grow the index.\n");
+    exit(1);
+  }
+  memcpy(entry->name, name, nameLength);
+  entry->name[nameLength] = '\0';
+  return entry;
+}
+
+static int
+indexCompareEntries(const void* a, const void* b)
+{
+  return strcmp((*(seqioIndexEntry**)a)->name, (*(seqioIndexEntry**)b)->name);
+}
+
+static int
+indexCompareName(const void* key, const void* entry)
+{
+  return strcmp((const char*)key, (*(seqioIndexEntry**)entry)->name);
+}
+
+static inline void
+indexSort(seqioIndex* index)
+{
+  index->sorted = (seqioIndexEntry**)seqioMalloc(sizeof(seqioIndexEntry*)
+                                                 * (index->count + 1));
+  if (index->sorted == NULL) {
+    fprintf(stderr, "Failed to grow the index.\n");
+    exit(1);
+  }
+  for (size_t i = 0; i < index->count; i++) {
+    index->sorted[i] = &index->entries[i];
+  }
+  qsort(index->sorted, index->count, sizeof(seqioIndexEntry*),
+        indexCompareEntries);
+}
+
+void
+seqioIndexFree(seqioIndex* index)
+{
+  if (index == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < index->count; i++) {
+    seqioFree(index->entries[i].name);
+  }
+  seqioFree(index->entries);
+  seqioFree(index->sorted);
+  seqioFree(index);
+}
+
+seqioIndexEntry*
+seqioIndexFind(seqioIndex* index, const char* name)
+{
+  seqioIndexEntry** found =
+      (seqioIndexEntry**)bsearch(name, index->sorted, index->count,
+                                 sizeof(seqioIndexEntry*), indexCompareName);
+  return found ? *found : NULL;
+}
+
+typedef struct {
+  seqioIndex* index;
+  seqioIndexEntry* entry;
+  seqioString* name;
+  bool inHeader;
+  bool shortLine;
+  size_t lineBytes;
+  char lastChar;
+} indexBuilder;
+
+static inline bool
+indexEndLine(indexBuilder* ib, size_t offset, bool hasNewline)
+{
+  if (ib->inHeader) {
+    size_t length = 0;
+    // the name ends at the first blank
+    char* data = ib->name->data;
+    while (length < ib->name->length && data[length] != ' '
+           && data[length] != '\t' && data[length] != '\r') {
+      length++;
+    }
+    ib->entry = indexAddEntry(ib->index, ib->name->data, length);
+    ib->entry->offset = offset;
+    ib->inHeader = false;
+    return true;
+  }
+  if (ib->entry == NULL) {
+    // text before the first header
+    return ib->lineBytes == 0;
+  }
+  size_t bases = ib->lineBytes;
+  if (bases && ib->lastChar == '\r') {
+    bases--;
+  }
+  size_t width = ib->lineBytes + hasNewline;
+  if (ib->entry->lineBases == 0) {
+    ib->entry->lineBases = bases;
+    ib->entry->lineWidth = width;
+  } else if (bases > ib->entry->lineBases || (bases && ib->shortLine)) {
+    fprintf(stderr, "Different line lengths in sequence %s.\n",
+            ib->entry->name);
+    return false;
+  } else if (bases < ib->entry->lineBases) {
+    ib->shortLine = true;
+  }
+  ib->entry->length += bases;
+  return true;
+}
+
+// Build filename.fai in one pass, and filename.gzi for a BGZF file. The
+// file may be plain or compressed, the .fai records uncompressed offsets.
+bool
+seqioBuildIndex(const char* filename)
+{
+  FILE* raw = fopen(filename, "rb");
+  if (raw == NULL) {
+    fprintf(stderr, "Failed to open %s.\n", filename);
+    return false;
+  }
+  unsigned char magic[18] = { 0 };
+  bool isBgzf = isBgzfHeader(magic, fread(magic, 1, 18, raw));
+  fclose(raw);
+  gzFile fp = gzopen(filename, "rb");
+  if (fp == NULL) {
+    fprintf(stderr, "Failed to open %s.\n", filename);
+    return false;
+  }
+  gzbuffer(fp, seqioDefaultBufferSize);
+  char* buffer = (char*)seqioMalloc(seqioDefaultBufferSize);
+  seqioIndex* index = (seqioIndex*)seqioMalloc(sizeof(seqioIndex));
+  if (buffer == NULL || index == NULL) {
+    fprintf(stderr, "Failed to allocate the index.\n");
+    exit(1);
+  }
+  memset(index, 0, sizeof(seqioIndex));
+  indexBuilder ib = { index, NULL, seqioStringNew(256), false, false, 0, 0 };
+  bool ok = true;
+  bool lineStart = true;
+  size_t offset = 0;
+  int bytesRead;
+  while (ok && (bytesRead = gzread(fp, buffer, seqioDefaultBufferSize)) > 0) {
+    char* p = buffer;
+    char* end = buffer + bytesRead;
+    while (ok && p < end) {
+      if (lineStart) {
+        if (*p == '@' && index->count == 0) {
+          fprintf(stderr, "Indexing FASTQ is not supported: %s.\n", filename);
+          ok = false;
+          break;
+        }
+        if (*p == '>') {
+          ib.inHeader = true;
+          ib.shortLine = false;
+          seqioStringClear(ib.name);
+          p++;
+        }
+        ib.lineBytes = 0;
+        lineStart = false;
+      }
+      char* newline = memchr(p, '\n', end - p);
+      char* stop = newline ? newline : end;
+      if (ib.inHeader) {
+        seqioStringAppend(ib.name, p, stop - p);
+      } else if (stop > p) {
+        ib.lineBytes += stop - p;
+        ib.lastChar = stop[-1];
+      }
+      if (newline) {
+        ok = indexEndLine(&ib, offset + (newline + 1 - buffer), true);
+        lineStart = true;
+        p = newline + 1;
+      } else {
+        p = end;
+      }
+    }
+    offset += bytesRead;
+  }
+  if (ok && !lineStart) {
+    ok = indexEndLine(&ib, offset, false);
+  }
+  gzclose(fp);
+  seqioFree(buffer);
+  seqioStringFree(ib.name);
+  if (ok && bytesRead < 0) {
+    fprintf(stderr, "Failed to read %s.\n", filename);
+    ok = false;
+  }
+  char* path = indexPath(filename, ".fai");
+  FILE* out = ok && path ? fopen(path, "w") : NULL;
+  if (ok && out == NULL) {
+    fprintf(stderr, "Failed to create %s.\n", path);
+    ok = false;
+  }
+  if (ok) {
+    for (size_t i = 0; i < index->count; i++) {
+      seqioIndexEntry* e = &index->entries[i];
+      fprintf(out, "%s\t%zu\t%zu\t%zu\t%zu\n", e->name, e->length, e->offset,
+              e->lineBases, e->lineWidth);
+    }
+    ok = fclose(out) == 0;
+  }
+  seqioFree(path);
+  seqioIndexFree(index);
+  if (ok && isBgzf) {
+    // offsets in the .fai are uncompressed, the .gzi maps them to blocks
+    ok = seqioBuildGzi(filename);
+  }
+  return ok;
+}
+
+// Load filename.fai, NULL if there is none or it is malformed.
+seqioIndex*
+seqioIndexLoad(const char* filename)
+{
+  char* path = indexPath(filename, ".fai");
+  FILE* fp = path ? fopen(path, "rb") : NULL;
+  seqioFree(path);
+  if (fp == NULL) {
+    return NULL;
+  }
+  seqioIndex* index = (seqioIndex*)seqioMalloc(sizeof(seqioIndex));
+  seqioString* line = seqioStringNew(256);
+  if (index == NULL) {
+    fclose(fp);
+    return NULL;
+  }
+  memset(index, 0, sizeof(seqioIndex));
+  bool ok = true;
+  int c;
+  do {
+    c = fgetc(fp);
+    if (c != '\n' && c != EOF) {
+      seqioStringAppendChar(line, (char)c);
+      continue;
+    }
+    if (line->length == 0) {
+      continue;
+    }
+    line->data[line->length] = '\0';
+    char* tab = strchr(line->data, '\t');
+    if (tab == NULL) {
+      ok = false;
+      break;
+    }
+    seqioIndexEntry* e = indexAddEntry(index, line->data, tab - line->data);
+    if (sscanf(tab + 1, "%zu\t%zu\t%zu\t%zu", &e->length, &e->offset,
+               &e->lineBases, &e->lineWidth)
+            != 4
+        || (e->length && e->lineBases == 0)) {
+      ok = false;
+      break;
+    }
+    seqioStringClear(line);
+  } while (c != EOF);
+  fclose(fp);
+  seqioStringFree(line);
+  if (!ok) {
+    fprintf(stderr, "Malformed index for %s.\n", filename);
+    seqioIndexFree(index);
+    return NULL;
+  }
+  indexSort(index);
+  return index;
+}
+
+// Offset in the file of base pos of a sequence.
+static inline size_t
+indexBaseOffset(seqioIndexEntry* entry, size_t pos)
+{
+  return entry->offset + pos / entry->lineBases * entry->lineWidth
+         + pos % entry->lineBases;
+}
+
+// Fetch bases [start, end) of a sequence, end is clamped to its length.
+// The index is loaded, or built, by the first call, and reading goes
+// through a handle of its own so the position of sf does not move. The
+// string belongs to sf and is reused by the next fetch, NULL if the
+// sequence is not in the index.
+seqioString*
+seqioFetch(seqioFile* sf, const char* name, size_t start, size_t end)
+{
+  const char* filename = sf->pravite.options->filename;
+  if (sf->pravite.index == NULL) {
+    if (filename == NULL || sf->pravite.mode != seqOpenModeRead) {
+      fprintf(stderr, "Only files opened for reading can be fetched from.\n");
+      return NULL;
+    }
+    if (sf->pravite.options->isGzipped && sf->pravite.bgzf == NULL) {
+      fprintf(stderr, "Fetching needs an uncompressed or BGZF file: %s.\n",
+              filename);
+      return NULL;
+    }
+    sf->pravite.index = seqioIndexLoad(filename);
+    if (sf->pravite.index == NULL && seqioBuildIndex(filename)) {
+      sf->pravite.index = seqioIndexLoad(filename);
+    }
+    if (sf->pravite.index == NULL) {
+      return NULL;
+    }
+    if (sf->pravite.bgzf != NULL) {
+      sf->pravite.gzi = gziLoad(filename);
+      if (sf->pravite.gzi == NULL && seqioBuildGzi(filename)) {
+        sf->pravite.gzi = gziLoad(filename);
+      }
+      if (sf->pravite.gzi == NULL) {
+        seqioIndexFree(sf->pravite.index);
+        sf->pravite.index = NULL;
+        return NULL;
+      }
+    }
+    sf->pravite.fetched = seqioStringNew(256);
+  }
+  seqioIndexEntry* entry = seqioIndexFind(sf->pravite.index, name);
+  if (entry == NULL) {
+    return NULL;
+  }
+  seqioString* fetched = sf->pravite.fetched;
+  seqioStringClear(fetched);
+  end = end < entry->length ? end : entry->length;
+  if (start >= end) {
+    return fetched;
+  }
+  size_t from = indexBaseOffset(entry, start);
+  size_t bytes = indexBaseOffset(entry, end - 1) + 1 - from;
+  seqioStringGrow(fetched, bytes);
+  char* data = fetched->data;
+  if (sf->pravite.gzi != NULL) {
+    if (!gziRead(sf->pravite.gzi, from, bytes, data)) {
+      return NULL;
+    }
+  } else if (sf->mapping.data != NULL) {
+    if (from + bytes > sf->mapping.size) {
+      return NULL;
+    }
+    memcpy(data, sf->mapping.data + from, bytes);
+  } else {
+    if (sf->pravite.fetchFile == NULL) {
+      sf->pravite.fetchFile = fopen(filename, "rb");
+    }
+    if (sf->pravite.fetchFile == NULL
+        || fseek(sf->pravite.fetchFile, from, SEEK_SET) != 0
+        || fread(data, 1, bytes, sf->pravite.fetchFile) != bytes) {
+      return NULL;
+    }
+  }
+  size_t length = 0;
+  for (size_t i = 0; i < bytes; i++) {
+    if (data[i] != '\n' && data[i] != '\r') {
+      data[length++] = data[i];
+    }
+  }
+  fetched->length = length;
+  data[length] = '\0';
+  return fetched;
+}
+
+// A .fqi maps the ordinal of every record to the offset of its first byte
+// and, through an open addressing table over name hashes, a name to its
+// ordinal. Names are not stored, a lookup checks the name in the file.
+// Layout, all little-endian: "FQI\1", 4 reserved bytes, the record count,
+// the bucket count, one 64-bit offset per record and one 64-bit ordinal + 1
+// per bucket, 0 for an empty one.
+#define seqioRecordIndexHeaderSize 32
+#define seqioRecordIndexVersion 2
+
+struct seqioRecordIndex {
+  char* data;
+  size_t size;
+  size_t count;
+  size_t bucketCount;
+  const unsigned char* offsets;
+  const unsigned char* buckets;
+};
+
+typedef struct {
+  uint64_t* offsets;
+  uint64_t* hashes;
+  size_t count;
+  size_t capacity;
+} recordIndexChunk;
+
+typedef struct {
+  seqioRecordType type;
+  char* data;
+  size_t size;
+  size_t chunkSize;
+  size_t chunkCount;
+  size_t nextChunk;
+  recordIndexChunk* chunks;
+  seqioMutex lock;
+} recordIndexBuilder;
+
+// Length of the name a header starts with, a name ends like readHeader
+// ends it but without a carriage return.
+static inline size_t
+recordNameLength(const char* name, const char* end)
+{
+  const char* p = name;
+  while (p < end && *p != ' ' && *p != '\n') {
+    p++;
+  }
+  if (p > name && p[-1] == '\r') {
+    p--;
+  }
+  return p - name;
+}
+
+// FNV-1a
+static inline uint64_t
+recordNameHash(const char* name, size_t length)
+{
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)name[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+static inline void
+recordIndexAdd(recordIndexChunk* chunk, uint64_t offset, uint64_t hash)
+{
+  if (chunk->count == chunk->capacity) {
+    size_t capacity = chunk->capacity ? chunk->capacity * 2 : 1024;
+    uint64_t* offsets = (uint64_t*)seqioRealloc(chunk->offsets,
+                                                sizeof(uint64_t) * capacity);
+    if (offsets != NULL) {
+      chunk->offsets = offsets;
+    }
+    uint64_t* hashes =
+        (uint64_t*)seqioRealloc(chunk->hashes, sizeof(uint64_t) * capacity);
+    if (hashes != NULL) {
+      chunk->hashes = hashes;
+    }
+    if (offsets == NULL || hashes == NULL) {
+      fprintf(stderr, "Failed to grow the record index.\n");
+      exit(1);
+    }
+    chunk->capacity = capacity;
+  }
+  chunk->offsets[chunk->count] = offset;
+  chunk->hashes[chunk->count] = hash;
+  chunk->count++;
+}
+
+// Chunks are split and synced the way seqioParallelRead splits them.
+static void*
+recordIndexWorker(void* arg)
+{
+  recordIndexBuilder* rb = (recordIndexBuilder*)arg;
+  char* end = rb->data + rb->size;
+  char marker = rb->type == seqioRecordTypeFasta ? '>' : '@';
+  seqioRecord* record = recordNew(NULL, rb->type, 0);
+  seqioString* sequence = seqioStringNew(256);
+  seqioString* quality = seqioStringNew(256);
+  if (record == NULL) {
+    fprintf(stderr, "Failed to allocate a record.\n");
+    exit(1);
+  }
+  while (1) {
+    mutexLock(&rb->lock);
+    size_t chunk = rb->nextChunk++;
+    mutexUnlock(&rb->lock);
+    if (chunk >= rb->chunkCount) {
       break;
     }
-    char* sep_stop = memchr(buff, '\n', sf->buffer.left);
-    if (sep_stop == NULL) {
-      seqioStringAppend(s, buff, sf->buffer.left);
-      sf->buffer.left = 0;
-      sf->buffer.offset = 0;
-      continue;
+    char* chunkEnd = rb->data + chunk * rb->chunkSize + rb->chunkSize;
+    chunkEnd = chunkEnd < end ? chunkEnd : end;
+    char* p = syncRecordStart(rb->type, rb->data,
+                              rb->data + chunk * rb->chunkSize, chunkEnd, end);
+    while (p < chunkEnd) {
+      size_t length = recordNameLength(p + 1, end);
+      recordIndexAdd(&rb->chunks[chunk], p - rb->data,
+                     recordNameHash(p + 1, length));
+      if (rb->type == seqioRecordTypeFasta) {
+        p = viewFastaRecord(record, sequence, p, end);
+      } else {
+        p = viewFastqRecord(record, sequence, quality, p, end);
+      }
+      if (p < chunkEnd && *p != marker) {
+        p = syncRecordStart(rb->type, rb->data, p, chunkEnd, end);
+      }
+    }
+  }
+  seqioFreeRecord(record);
+  seqioStringFree(sequence);
+  seqioStringFree(quality);
+  return NULL;
+}
+
+static inline bool
+writeLE64Array(FILE* fp, const uint64_t* values, size_t count)
+{
+  unsigned char staging[8 * 1024];
+  while (count > 0) {
+    size_t n = count < 1024 ? count : 1024;
+    for (size_t i = 0; i < n; i++) {
+      writeLE64(staging + 8 * i, values[i]);
+    }
+    if (fwrite(staging, 8, n, fp) != n) {
+      return false;
+    }
+    values += n;
+    count -= n;
+  }
+  return true;
+}
+
+static inline bool
+recordIndexWrite(const char* filename, recordIndexBuilder* rb)
+{
+  size_t count = 0;
+  for (size_t i = 0; i < rb->chunkCount; i++) {
+    count += rb->chunks[i].count;
+  }
+  size_t bucketCount = 1;
+  while (bucketCount < count * 2) {
+    bucketCount *= 2;
+  }
+  uint64_t* offsets = (uint64_t*)seqioMalloc(sizeof(uint64_t) * (count + 1));
+  uint64_t* buckets = (uint64_t*)seqioMalloc(sizeof(uint64_t) * bucketCount);
+  if (offsets == NULL || buckets == NULL) {
+    fprintf(stderr, "Failed to allocate the record index.\n");
+    exit(1);
+  }
+  memset(buckets, 0, sizeof(uint64_t) * bucketCount);
+  size_t ordinal = 0;
+  for (size_t i = 0; i < rb->chunkCount; i++) {
+    recordIndexChunk* chunk = &rb->chunks[i];
+    for (size_t j = 0; j < chunk->count; j++, ordinal++) {
+      offsets[ordinal] = chunk->offsets[j];
+      size_t bucket = chunk->hashes[j] & (bucketCount - 1);
+      while (buckets[bucket] != 0) {
+        bucket = (bucket + 1) & (bucketCount - 1);
+      }
+      buckets[bucket] = ordinal + 1;
+    }
+  }
+  char* path = indexPath(filename, ".fqi");
+  FILE* fp = path ? fopen(path, "wb") : NULL;
+  bool ok = fp != NULL;
+  if (ok) {
+    unsigned char header[seqioRecordIndexHeaderSize] = {
+      'F', 'Q', 'I', seqioRecordIndexVersion
+    };
+    writeLE64(header + 8, count);
+    writeLE64(header + 16, bucketCount);
+    writeLE64(header + 24, rb->size);
+    ok = fwrite(header, 1, sizeof(header), fp) == sizeof(header)
+         && writeLE64Array(fp, offsets, count)
+         && writeLE64Array(fp, buckets, bucketCount);
+    ok = fclose(fp) == 0 && ok;
+  }
+  if (!ok) {
+    fprintf(stderr, "Failed to create the record index of %s.\n", filename);
+  }
+  seqioFree(path);
+  seqioFree(offsets);
+  seqioFree(buckets);
+  return ok;
+}
+
+// Build filename.fqi in one pass over the mapped file, split between
+// threads. Only uncompressed files can be indexed.
+bool
+seqioBuildRecordIndex(const char* filename, int threads)
+{
+  FILE* fp = fopen(filename, "rb");
+  if (fp == NULL) {
+    fprintf(stderr, "Failed to open %s.\n", filename);
+    return false;
+  }
+  unsigned char magic[2] = { 0 };
+  if (fread(magic, 1, 2, fp) == 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+    fclose(fp);
+    fprintf(stderr, "Record indexes need an uncompressed file: %s.\n",
+            filename);
+    return false;
+  }
+  fseek(fp, 0, SEEK_SET);
+  size_t size = 0;
+  char* data = mapFile(fp, &size);
+  fclose(fp);
+  if (data == NULL) {
+    fprintf(stderr, "Failed to map %s.\n", filename);
+    return false;
+  }
+  recordIndexBuilder rb;
+  memset(&rb, 0, sizeof(recordIndexBuilder));
+  rb.type = mappedRecordType(data, size);
+  rb.data = data;
+  rb.size = size;
+  rb.chunkSize = seqioParallelChunkSize;
+  rb.chunkCount = (size + rb.chunkSize - 1) / rb.chunkSize;
+  rb.chunks = (recordIndexChunk*)seqioMalloc(sizeof(recordIndexChunk)
+                                             * rb.chunkCount);
+  if (rb.type == seqioRecordTypeUnknown || rb.chunks == NULL) {
+    seqioFree(rb.chunks);
+    unmapFile(data, size);
+    fprintf(stderr, "No records to index in %s.\n", filename);
+    return false;
+  }
+  memset(rb.chunks, 0, sizeof(recordIndexChunk) * rb.chunkCount);
+  mutexInit(&rb.lock);
+  threads = threads > 1 ? threads : 1;
+  seqioThread* workers =
+      (seqioThread*)seqioMalloc(sizeof(seqioThread) * threads);
+  int started = 0;
+  if (workers != NULL) {
+    while (started < threads
+           && threadCreate(&workers[started], recordIndexWorker, &rb)) {
+      started++;
+    }
+  }
+  if (started == 0) {
+    recordIndexWorker(&rb);
+  }
+  for (int i = 0; i < started; i++) {
+    threadJoin(workers[i]);
+  }
+  seqioFree(workers);
+  mutexDestroy(&rb.lock);
+  unmapFile(data, size);
+  bool ok = recordIndexWrite(filename, &rb);
+  for (size_t i = 0; i < rb.chunkCount; i++) {
+    seqioFree(rb.chunks[i].offsets);
+    seqioFree(rb.chunks[i].hashes);
+  }
+  seqioFree(rb.chunks);
+  return ok;
+}
+
+static void
+recordIndexFree(seqioRecordIndex* ri)
+{
+  if (ri == NULL) {
+    return;
+  }
+  unmapFile(ri->data, ri->size);
+  seqioFree(ri);
+}
+
+// Map filename.fqi, nothing is read until a lookup needs it. An index of
+// another version or of a file of another size than dataSize is stale and
+// quietly left to be rebuilt.
+static seqioRecordIndex*
+recordIndexLoad(const char* filename, size_t dataSize)
+{
+  char* path = indexPath(filename, ".fqi");
+  FILE* fp = path ? fopen(path, "rb") : NULL;
+  seqioFree(path);
+  if (fp == NULL) {
+    return NULL;
+  }
+  size_t size = 0;
+  char* data = mapFile(fp, &size);
+  fclose(fp);
+  if (data == NULL) {
+    return NULL;
+  }
+  const unsigned char* header = (const unsigned char*)data;
+  if (size >= 4 && memcmp(header, "FQI", 3) == 0
+      && (header[3] != seqioRecordIndexVersion
+          || (size >= seqioRecordIndexHeaderSize
+              && readLE64(header + 24) != dataSize))) {
+    unmapFile(data, size);
+    return NULL;
+  }
+  uint64_t count = size >= seqioRecordIndexHeaderSize ? readLE64(header + 8) : 0;
+  uint64_t bucketCount =
+      size >= seqioRecordIndexHeaderSize ? readLE64(header + 16) : 0;
+  seqioRecordIndex* ri =
+      (seqioRecordIndex*)seqioMalloc(sizeof(seqioRecordIndex));
+  if (ri == NULL || size < seqioRecordIndexHeaderSize
+      || memcmp(header, "FQI", 3) != 0 || bucketCount == 0
+      || (bucketCount & (bucketCount - 1)) != 0 || bucketCount <= count
+      || size != seqioRecordIndexHeaderSize + 8 * (count + bucketCount)) {
+    fprintf(stderr, "Malformed record index for %s.\n", filename);
+    seqioFree(ri);
+    unmapFile(data, size);
+    return NULL;
+  }
+  ri->data = data;
+  ri->size = size;
+  ri->count = count;
+  ri->bucketCount = bucketCount;
+  ri->offsets = header + seqioRecordIndexHeaderSize;
+  ri->buckets = ri->offsets + 8 * count;
+  return ri;
+}
+
+// The record index of a file, loaded or built on first use.
+static inline seqioRecordIndex*
+recordIndexOf(seqioFile* sf)
+{
+  if (sf->pravite.recordIndex != NULL) {
+    return sf->pravite.recordIndex;
+  }
+  const char* filename = sf->pravite.options->filename;
+  if (filename == NULL || sf->pravite.mode != seqOpenModeRead
+      || sf->pravite.options->isGzipped) {
+    fprintf(stderr, "Only uncompressed files opened for reading can seek.\n");
+    return NULL;
+  }
+  size_t size = sf->fileStats.fileSize;
+  sf->pravite.recordIndex = recordIndexLoad(filename, size);
+  if (sf->pravite.recordIndex == NULL
+      && seqioBuildRecordIndex(filename, sf->pravite.options->threads)) {
+    sf->pravite.recordIndex = recordIndexLoad(filename, size);
+  }
+  return sf->pravite.recordIndex;
+}
+
+// Move the reader to a record start, the next read returns that record.
+static inline void
+seekRecordOffset(seqioFile* sf, size_t offset)
+{
+  if (sf->mapping.data) {
+    resetMappedBuffer(sf);
+    sf->buffer.offset = offset;
+    sf->buffer.left = sf->mapping.size - offset;
+  } else {
+    if (sf->pravite.readAhead) {
+      readAheadStop(sf->pravite.readAhead);
+    }
+    fseek(sf->pravite.file, offset, SEEK_SET);
+    if (sf->pravite.readAhead) {
+      readAheadStart(sf->pravite.readAhead);
+    }
+    sf->pravite.isEOF = false;
+    resetBuffer(sf);
+  }
+  sf->pravite.state = READ_STATUS_NONE;
+  sf->fileStats.fileOffset = offset;
+}
+
+size_t
+seqioRecordCount(seqioFile* sf)
+{
+  seqioRecordIndex* ri = recordIndexOf(sf);
+  return ri ? ri->count : 0;
+}
+
+// Position the file so the next read returns record ordinal, counted
+// from 0. Returns false if there is no such record.
+bool
+seqioSeekRecord(seqioFile* sf, size_t ordinal)
+{
+  seqioRecordIndex* ri = recordIndexOf(sf);
+  if (ri == NULL || ordinal >= ri->count) {
+    return false;
+  }
+  size_t offset = readLE64(ri->offsets + 8 * ordinal);
+  if (sf->mapping.data && offset >= sf->mapping.size) {
+    return false;
+  }
+  seekRecordOffset(sf, offset);
+  return true;
+}
+
+// Does the record at offset have this name?
+static inline bool
+recordNameAt(seqioFile* sf, size_t offset, const char* name, size_t length)
+{
+  const char* header;
+  size_t size;
+  if (sf->mapping.data) {
+    if (offset >= sf->mapping.size) {
+      return false;
+    }
+    header = sf->mapping.data + offset;
+    size = sf->mapping.size - offset;
+  } else {
+    // the marker, the name and the byte that ends it, maybe two
+    if (sf->pravite.fetchFile == NULL) {
+      sf->pravite.fetchFile = fopen(sf->pravite.options->filename, "rb");
     }
-    size_t sep = sep_stop - buff;
-    if (!sep) {
-      sf->buffer.left--;
-      sf->buffer.offset++;
-      continue;
+    if (sf->pravite.fetched == NULL) {
+      sf->pravite.fetched = seqioStringNew(256);
     }
-    if (buff[sep - 1] == '\r') {
-      sep--;
+    seqioString* s = sf->pravite.fetched;
+    seqioStringClear(s);
+    seqioStringGrow(s, length + 3);
+    if (sf->pravite.fetchFile == NULL
+        || fseek(sf->pravite.fetchFile, offset, SEEK_SET) != 0) {
+      return false;
     }
-    sf->buffer.left -= sep + 1;
-    sf->buffer.offset += sep + 1;
-    seqioStringAppend(s, buff, sep);
+    size = fread(s->data, 1, length + 3, sf->pravite.fetchFile);
+    header = s->data;
   }
+  return size > length && recordNameLength(header + 1, header + size) == length
+         && memcmp(header + 1, name, length) == 0;
 }
 
-// Read until one of two delimiter characters, optimized for name/comment reading
-static inline char
-readUntilEither(seqioFile* sf, seqioString* s, char delim1, char delim2)
+// Position the file so the next read returns the record with this name.
+// Returns false if there is none.
+bool
+seqioSeekName(seqioFile* sf, const char* name)
 {
-  while (1) {
-    size_t readSize = readDataToBuffer(sf);
-    if (readSize == 0) {
-      return '\0';
+  seqioRecordIndex* ri = recordIndexOf(sf);
+  if (ri == NULL) {
+    return false;
+  }
+  size_t length = strlen(name);
+  size_t mask = ri->bucketCount - 1;
+  size_t bucket = recordNameHash(name, length) & mask;
+  // a free bucket ends a lookup, but a damaged table may have none
+  for (size_t probe = 0; probe < ri->bucketCount; probe++) {
+    uint64_t entry = readLE64(ri->buckets + 8 * bucket);
+    if (entry == 0) {
+      break;
     }
-    char* buff = sf->buffer.data + sf->buffer.offset;
-    
-    // Find the first occurrence of either delimiter
-    size_t i;
-    for (i = 0; i < sf->buffer.left; i++) {
-      if (buff[i] == delim1 || buff[i] == delim2 || buff[i] == '\r') {
-        break;
+    if (entry <= ri->count) {
+      size_t offset = readLE64(ri->offsets + 8 * (entry - 1));
+      if (recordNameAt(sf, offset, name, length)) {
+        seekRecordOffset(sf, offset);
+        return true;
       }
     }
-    
-    // Append the chunk before the delimiter
-    if (i > 0) {
-      seqioStringAppend(s, buff, i);
-      sf->buffer.offset += i;
-      sf->buffer.left -= i;
+    bucket = (bucket + 1) & mask;
+  }
+  return false;
+}
+
+// Arena blocks are chained and kept across resets, so a steady workload
+// stops calling malloc once the arena has grown to its peak.
+typedef struct seqioArenaBlock {
+  struct seqioArenaBlock* next;
+  size_t size;
+  size_t used;
+} seqioArenaBlock;
+
+struct seqioArena {
+  seqioAllocator allocator;
+  size_t blockSize;
+  seqioArenaBlock* head;
+  seqioArenaBlock* current;
+  // the latest allocation, the only one that can grow in place
+  char* last;
+};
+
+#define seqioAllocAlign 16
+#define alignUp(size)                                                         \
+  (((size) + seqioAllocAlign - 1) & ~(size_t)(seqioAllocAlign - 1))
+
+static inline char*
+arenaBlockData(seqioArenaBlock* block)
+{
+  return (char*)block + alignUp(sizeof(seqioArenaBlock));
+}
+
+static void*
+arenaAlloc(void* context, size_t size)
+{
+  seqioArena* arena = (seqioArena*)context;
+  size = size ? alignUp(size) : seqioAllocAlign;
+  seqioArenaBlock* block = arena->current;
+  while (block != NULL && block->used + size > block->size) {
+    block = block->next;
+  }
+  if (block == NULL) {
+    size_t blockSize = size > arena->blockSize ? size : arena->blockSize;
+    block = (seqioArenaBlock*)seqioMalloc(alignUp(sizeof(seqioArenaBlock))
+                                          + blockSize);
+    if (block == NULL) {
+      return NULL;
     }
-    
-    // Check if we found a delimiter
-    if (i < readSize) {
-      char found = sf->buffer.data[sf->buffer.offset];
-      if (found == '\r') {
-        // Skip \r and continue
-        sf->buffer.offset++;
-        sf->buffer.left--;
-        continue;
-      }
-      // Return the delimiter found
-      sf->buffer.offset++;
-      sf->buffer.left--;
-      return found;
+    block->size = blockSize;
+    block->used = 0;
+    // blocks after the current one are still empty, keep them for later
+    if (arena->current) {
+      block->next = arena->current->next;
+      arena->current->next = block;
+    } else {
+      block->next = arena->head;
+      arena->head = block;
     }
   }
+  arena->current = block;
+  char* p = arenaBlockData(block) + block->used;
+  block->used += size;
+  arena->last = p;
+  return p;
 }
 
-seqioRecord*
-seqioReadFasta(seqioFile* sf, seqioRecord* record)
+static void*
+arenaResize(void* context, void* ptr, size_t oldSize, size_t size)
 {
-  if (sf->pravite.isEOF && sf->buffer.left == 0) {
-    if (sf->pravite.options->freeRecordOnEOF) {
-      seqioFreeRecord(record);
+  seqioArena* arena = (seqioArena*)context;
+  if (ptr != NULL && ptr == arena->last) {
+    seqioArenaBlock* block = arena->current;
+    size_t offset = (char*)ptr - arenaBlockData(block);
+    size_t used = offset + (size ? alignUp(size) : seqioAllocAlign);
+    if (used <= block->size) {
+      block->used = used;
+      return ptr;
     }
-    sf->record = NULL;
-    sf->fileStats.fileOffset = sf->fileStats.fileSize;
+  }
+  void* p = arenaAlloc(context, size);
+  if (p != NULL && ptr != NULL) {
+    memcpy(p, ptr, oldSize < size ? oldSize : size);
+  }
+  return p;
+}
+
+static void
+arenaRelease(void* context, void* ptr, size_t size)
+{
+  (void)size;
+  seqioArena* arena = (seqioArena*)context;
+  if (ptr != NULL && ptr == arena->last) {
+    arena->current->used = (char*)ptr - arenaBlockData(arena->current);
+    arena->last = NULL;
+  }
+}
+
+seqioArena*
+seqioArenaNew(size_t blockSize)
+{
+  seqioArena* arena = (seqioArena*)seqioMalloc(sizeof(seqioArena));
+  if (arena == NULL) {
     return NULL;
   }
-  ensureFastaRecord(sf, "Cannot read fasta record from a fastq file.");
-  if (record == NULL) {
-    record = seqioMalloc(sizeof(seqioRecord));
-    if (record == NULL) {
+  arena->allocator.alloc = arenaAlloc;
+  arena->allocator.resize = arenaResize;
+  arena->allocator.release = arenaRelease;
+  arena->allocator.context = arena;
+  arena->allocator.bulkRelease = true;
+  arena->blockSize = blockSize ? blockSize : seqioDefaultArenaBlockSize;
+  arena->head = NULL;
+  arena->current = NULL;
+  arena->last = NULL;
+  return arena;
+}
+
+void
+seqioArenaFree(seqioArena* arena)
+{
+  if (arena == NULL) {
+    return;
+  }
+  seqioArenaBlock* block = arena->head;
+  while (block != NULL) {
+    seqioArenaBlock* next = block->next;
+    seqioFree(block);
+    block = next;
+  }
+  seqioFree(arena);
+}
+
+// Drop every allocation at once. Records and batches allocated from the
+// arena must not be used afterwards.
+void
+seqioArenaReset(seqioArena* arena)
+{
+  for (seqioArenaBlock* block = arena->head; block; block = block->next) {
+    block->used = 0;
+  }
+  arena->current = arena->head;
+  arena->last = NULL;
+}
+
+seqioAllocator*
+seqioArenaAllocator(seqioArena* arena)
+{
+  return &arena->allocator;
+}
+
+// Pool chunks are chained through their first bytes, free blocks through
+// theirs.
+struct seqioPool {
+  seqioAllocator allocator;
+  size_t blockSize;
+  size_t blocksPerChunk;
+  void* chunks;
+  void* freeList;
+};
+
+static void*
+poolAlloc(void* context, size_t size)
+{
+  seqioPool* pool = (seqioPool*)context;
+  if (size > pool->blockSize) {
+    return seqioMalloc(size);
+  }
+  if (pool->freeList == NULL) {
+    size_t header = alignUp(sizeof(void*));
+    char* chunk = (char*)seqioMalloc(header
+                                     + pool->blockSize * pool->blocksPerChunk);
+    if (chunk == NULL) {
       return NULL;
     }
-    record->type = seqioRecordTypeFasta;
-    record->name = seqioStringNew(256);
-    record->comment = seqioStringNew(256);
-    record->sequence = seqioStringNew(256);
-    record->quality = seqioStringNew(256);
-  } else {
-    record->type = seqioRecordTypeFasta;
-    seqioStringClear(record->name);
-    seqioStringClear(record->comment);
-    seqioStringClear(record->sequence);
+    *(void**)chunk = pool->chunks;
+    pool->chunks = chunk;
+    for (size_t i = pool->blocksPerChunk; i > 0; i--) {
+      void* block = chunk + header + pool->blockSize * (i - 1);
+      *(void**)block = pool->freeList;
+      pool->freeList = block;
+    }
   }
-  readStatus status = sf->pravite.state;
-  int c;
-  while (1) {
-    size_t readSize = readDataToBuffer(sf);
-    if (readSize == 0) {
-      break;
+  void* block = pool->freeList;
+  pool->freeList = *(void**)block;
+  return block;
+}
+
+static void
+poolRelease(void* context, void* ptr, size_t size)
+{
+  seqioPool* pool = (seqioPool*)context;
+  if (ptr == NULL) {
+    return;
+  }
+  if (size > pool->blockSize) {
+    seqioFree(ptr);
+    return;
+  }
+  *(void**)ptr = pool->freeList;
+  pool->freeList = ptr;
+}
+
+static void*
+poolResize(void* context, void* ptr, size_t oldSize, size_t size)
+{
+  seqioPool* pool = (seqioPool*)context;
+  if (ptr == NULL) {
+    return poolAlloc(context, size);
+  }
+  bool wasBlock = oldSize <= pool->blockSize;
+  bool isBlock = size <= pool->blockSize;
+  if (wasBlock && isBlock) {
+    return ptr;
+  }
+  if (!wasBlock && !isBlock) {
+    return seqioRealloc(ptr, size);
+  }
+  void* p = poolAlloc(context, size);
+  if (p != NULL) {
+    memcpy(p, ptr, oldSize < size ? oldSize : size);
+    poolRelease(context, ptr, oldSize);
+  }
+  return p;
+}
+
+seqioPool*
+seqioPoolNew(size_t blockSize, size_t blocksPerChunk)
+{
+  seqioPool* pool = (seqioPool*)seqioMalloc(sizeof(seqioPool));
+  if (pool == NULL) {
+    return NULL;
+  }
+  pool->allocator.alloc = poolAlloc;
+  pool->allocator.resize = poolResize;
+  pool->allocator.release = poolRelease;
+  pool->allocator.context = pool;
+  pool->allocator.bulkRelease = false;
+  blockSize = blockSize ? blockSize : seqioDefaultPoolBlockSize;
+  pool->blockSize = alignUp(blockSize);
+  pool->blocksPerChunk =
+      blocksPerChunk ? blocksPerChunk : seqioDefaultPoolBlocksPerChunk;
+  pool->chunks = NULL;
+  pool->freeList = NULL;
+  return pool;
+}
+
+void
+seqioPoolFree(seqioPool* pool)
+{
+  if (pool == NULL) {
+    return;
+  }
+  void* chunk = pool->chunks;
+  while (chunk != NULL) {
+    void* next = *(void**)chunk;
+    seqioFree(chunk);
+    chunk = next;
+  }
+  seqioFree(pool);
+}
+
+seqioAllocator*
+seqioPoolAllocator(seqioPool* pool)
+{
+  return &pool->allocator;
+}
+
+static bool
+packedReserve(seqioPacked* packed, size_t length)
+{
+  if (length <= packed->capacity) {
+    return true;
+  }
+  // keep the capacity a multiple of 64 so the mask has whole words
+  size_t capacity = packed->capacity ? packed->capacity * 2 : 1024;
+  while (capacity < length) {
+    capacity *= 2;
+  }
+  uint8_t* bases = (uint8_t*)seqioRealloc(packed->bases, capacity / 4);
+  if (bases == NULL) {
+    return false;
+  }
+  packed->bases = bases;
+  uint64_t* mask =
+      (uint64_t*)seqioRealloc(packed->mask, capacity / 64 * sizeof(uint64_t));
+  if (mask == NULL) {
+    return false;
+  }
+  packed->mask = mask;
+  packed->capacity = capacity;
+  return true;
+}
+
+seqioPacked*
+seqioPackedNew(size_t capacity)
+{
+  seqioPacked* packed = (seqioPacked*)seqioMalloc(sizeof(seqioPacked));
+  if (packed == NULL) {
+    return NULL;
+  }
+  memset(packed, 0, sizeof(seqioPacked));
+  if (capacity && !packedReserve(packed, capacity)) {
+    seqioPackedFree(packed);
+    return NULL;
+  }
+  return packed;
+}
+
+void
+seqioPackedFree(seqioPacked* packed)
+{
+  if (packed == NULL) {
+    return;
+  }
+  seqioFree(packed->bases);
+  seqioFree(packed->mask);
+  seqioFree(packed->exceptions);
+  seqioFree(packed);
+}
+
+void
+seqioPackedClear(seqioPacked* packed)
+{
+  packed->length = 0;
+  packed->exceptionCount = 0;
+}
+
+static bool
+packedException(seqioPacked* packed, size_t offset, char base)
+{
+  if (packed->exceptionCount) {
+    seqioPackedRun* last = &packed->exceptions[packed->exceptionCount - 1];
+    if (last->base == base && last->offset + last->length == offset) {
+      last->length++;
+      return true;
     }
-    char* buff = sf->buffer.data + sf->buffer.offset;
-    for (size_t i = 0; i < readSize; i++) {
-      c = buff[i];
-      forwardBufferOne(sf);
-      if (c == '\r' || c == '\t') {
-        continue;
-      }
-      switch (status) {
-      case READ_STATUS_NONE: {
-        if (c == '>') {
-          status = READ_STATUS_NAME;
-          // Use optimized batch reading for name
-          char delim = readUntilEither(sf, record->name, ' ', '\n');
-          record->name->data[record->name->length] = '\0';
-          if (delim == ' ') {
-            status = READ_STATUS_COMMENT;
-            // Use optimized batch reading for comment
-            delim = readUntilEither(sf, record->comment, '\n', '\n');
-            record->comment->data[record->comment->length] = '\0';
-            status = READ_STATUS_SEQUENCE;
-          } else if (delim == '\n') {
-            status = READ_STATUS_SEQUENCE;
-          }
-          // Now read sequence
-          if (status == READ_STATUS_SEQUENCE) {
-            readUntil(sf, record->sequence, '>', READ_STATUS_NAME);
-            record->sequence->data[record->sequence->length] = '\0';
-            sf->record = (seqioRecord*)record;
-            seqioTell(sf);
-            return record;
-          }
-        }
-        break;
-      }
-      case READ_STATUS_NAME: {
-        // This state should not be reached with optimized reading
-        if (c == ' ') {
-          status = READ_STATUS_COMMENT;
-          record->name->data[record->name->length] = '\0';
-        } else if (c == '\n') {
-          status = READ_STATUS_SEQUENCE;
-          record->name->data[record->name->length] = '\0';
-        } else {
-          seqioStringAppendChar(record->name, c);
-        }
-        break;
-      }
-      case READ_STATUS_COMMENT: {
-        // This state should not be reached with optimized reading
-        if (c == '\n') {
-          status = READ_STATUS_SEQUENCE;
-          record->comment->data[record->comment->length] = '\0';
-        } else {
-          seqioStringAppendChar(record->comment, c);
-        }
-        break;
-      }
-      case READ_STATUS_SEQUENCE: {
-        // back to the first char of this line
-        backwardBufferOne(sf);
-        readUntil(sf, record->sequence, '>', READ_STATUS_NAME);
-        record->sequence->data[record->sequence->length] = '\0';
-        sf->record = (seqioRecord*)record;
-        seqioTell(sf);
-        return record;
-      }
-      default: {
-        break;
-      }
+  }
+  if (packed->exceptionCount == packed->exceptionCapacity) {
+    size_t capacity =
+        packed->exceptionCapacity ? packed->exceptionCapacity * 2 : 16;
+    seqioPackedRun* exceptions = (seqioPackedRun*)seqioRealloc(
+        packed->exceptions, sizeof(seqioPackedRun) * capacity);
+    if (exceptions == NULL) {
+      return false;
+    }
+    packed->exceptions = exceptions;
+    packed->exceptionCapacity = capacity;
+  }
+  seqioPackedRun* run = &packed->exceptions[packed->exceptionCount++];
+  run->offset = offset;
+  run->length = 1;
+  run->base = base;
+  return true;
+}
+
+static inline int
+packCode(char c)
+{
+  switch (c) {
+  case 'A':
+    return 0;
+  case 'C':
+    return 1;
+  case 'G':
+    return 2;
+  case 'T':
+    return 3;
+  default:
+    return -1;
+  }
+}
+
+// Pack one base at the end. Whole bytes and mask words are assigned rather
+// than or-ed into, so a cleared packed sequence needs no memset.
+static inline bool
+packOne(seqioPacked* packed, char c)
+{
+  size_t i = packed->length;
+  bool lower = c >= 'a' && c <= 'z';
+  if (lower) {
+    c -= 'a' - 'A';
+  }
+  int code = packCode(c);
+  if (code < 0) {
+    if (!packedException(packed, i, c)) {
+      return false;
+    }
+    code = 0;
+  }
+  if (i % 4 == 0) {
+    packed->bases[i / 4] = (uint8_t)code;
+  } else {
+    packed->bases[i / 4] |= (uint8_t)(code << (2 * (i % 4)));
+  }
+  if (i % 64 == 0) {
+    packed->mask[i / 64] = lower;
+  } else {
+    packed->mask[i / 64] |= (uint64_t)lower << (i % 64);
+  }
+  packed->length++;
+  return true;
+}
+
+// Pack 16 bases into 4 bytes and their case into 16 bits, false when one of
+// them is not A, C, G or T. Upper-case A, C, G and T are 0x41, 0x43, 0x47
+// and 0x54, and ((c >> 1) ^ (c >> 2)) & 3 maps them to 0 to 3.
+#if defined(SEQIO_SSE2)
+static inline bool
+packBlock16(const char* p, uint32_t* bases, uint32_t* lower)
+{
+  __m128i x = _mm_loadu_si128((const __m128i*)p);
+  __m128i isLower = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(x, _mm_set1_epi8('z' + 1)));
+  __m128i upper =
+      _mm_andnot_si128(_mm_and_si128(isLower, _mm_set1_epi8(0x20)), x);
+  __m128i valid = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(upper, _mm_set1_epi8('A')),
+                   _mm_cmpeq_epi8(upper, _mm_set1_epi8('C'))),
+      _mm_or_si128(_mm_cmpeq_epi8(upper, _mm_set1_epi8('G')),
+                   _mm_cmpeq_epi8(upper, _mm_set1_epi8('T'))));
+  if (_mm_movemask_epi8(valid) != 0xFFFF) {
+    return false;
+  }
+  __m128i codes = _mm_and_si128(
+      _mm_xor_si128(_mm_srli_epi16(upper, 1), _mm_srli_epi16(upper, 2)),
+      _mm_set1_epi8(3));
+  // gather 4 codes into the low byte of every 32-bit lane
+  __m128i t = _mm_or_si128(codes, _mm_srli_epi16(codes, 6));
+  t = _mm_or_si128(t, _mm_srli_epi32(t, 12));
+  t = _mm_and_si128(t, _mm_set1_epi32(0xFF));
+  t = _mm_packs_epi32(t, t);
+  t = _mm_packus_epi16(t, t);
+  *bases = (uint32_t)_mm_cvtsi128_si32(t);
+  *lower = (uint32_t)_mm_movemask_epi8(isLower);
+  return true;
+}
+#elif defined(SEQIO_NEON)
+static const uint8_t packBit[16] = { 1, 2, 4, 8, 16, 32, 64, 128,
+                                     1, 2, 4, 8, 16, 32, 64, 128 };
+
+static inline bool
+packBlock16(const char* p, uint32_t* bases, uint32_t* lower)
+{
+  uint8x16_t x = vld1q_u8((const uint8_t*)p);
+  uint8x16_t isLower =
+      vandq_u8(vcgeq_u8(x, vdupq_n_u8('a')), vcleq_u8(x, vdupq_n_u8('z')));
+  uint8x16_t upper = vbicq_u8(x, vandq_u8(isLower, vdupq_n_u8(0x20)));
+  uint8x16_t valid =
+      vorrq_u8(vorrq_u8(vceqq_u8(upper, vdupq_n_u8('A')),
+                        vceqq_u8(upper, vdupq_n_u8('C'))),
+               vorrq_u8(vceqq_u8(upper, vdupq_n_u8('G')),
+                        vceqq_u8(upper, vdupq_n_u8('T'))));
+  if (vminvq_u8(valid) == 0) {
+    return false;
+  }
+  uint8x16_t codes = vandq_u8(
+      veorq_u8(vshrq_n_u8(upper, 1), vshrq_n_u8(upper, 2)), vdupq_n_u8(3));
+  // gather 4 codes into the low byte of every 32-bit lane
+  uint16x8_t t16 = vreinterpretq_u16_u8(codes);
+  t16 = vsraq_n_u16(t16, t16, 6);
+  uint32x4_t t32 = vreinterpretq_u32_u16(t16);
+  t32 = vsraq_n_u32(t32, t32, 12);
+  uint8x8_t packed =
+      vmovn_u16(vcombine_u16(vmovn_u32(t32), vdup_n_u16(0)));
+  *bases = vget_lane_u32(vreinterpret_u32_u8(packed), 0);
+  uint8x16_t bits = vandq_u8(isLower, vld1q_u8(packBit));
+  *lower = (uint32_t)vaddv_u8(vget_low_u8(bits))
+           | (uint32_t)vaddv_u8(vget_high_u8(bits)) << 8;
+  return true;
+}
+#endif
+
+// Unpack 16 bases from 4 bytes, lower holds their case bits. Every byte is
+// spread over 4 lanes where one 2-bit field of it is kept and compared.
+#if defined(SEQIO_SSE2)
+static inline void
+unpackBlock16(const uint8_t* bases, unsigned lower, char* out)
+{
+  uint32_t word;
+  memcpy(&word, bases, sizeof(word));
+  __m128i v = _mm_cvtsi32_si128((int)word);
+  v = _mm_unpacklo_epi8(v, v);
+  v = _mm_unpacklo_epi16(v, v);
+  const __m128i field = _mm_set1_epi32((int)0xC0300C03u);
+  __m128i m = _mm_and_si128(v, field);
+  __m128i c = _mm_cmpeq_epi8(m, _mm_set1_epi32(0x40100401));
+  __m128i g = _mm_cmpeq_epi8(m, _mm_set1_epi32((int)0x80200802u));
+  __m128i t = _mm_cmpeq_epi8(m, field);
+  __m128i x = _mm_set1_epi8('A');
+  x = _mm_add_epi8(x, _mm_and_si128(c, _mm_set1_epi8('C' - 'A')));
+  x = _mm_add_epi8(x, _mm_and_si128(g, _mm_set1_epi8('G' - 'A')));
+  x = _mm_add_epi8(x, _mm_and_si128(t, _mm_set1_epi8('T' - 'A')));
+  const __m128i bit = _mm_set1_epi64x((long long)0x8040201008040201ull);
+  __m128i bits =
+      _mm_set_epi64x((long long)(((lower >> 8) & 0xFF) * 0x0101010101010101ull),
+                     (long long)((lower & 0xFF) * 0x0101010101010101ull));
+  __m128i isLower = _mm_cmpeq_epi8(_mm_and_si128(bits, bit), bit);
+  x = _mm_or_si128(x, _mm_and_si128(isLower, _mm_set1_epi8(0x20)));
+  _mm_storeu_si128((__m128i*)out, x);
+}
+#elif defined(SEQIO_NEON)
+static inline void
+unpackBlock16(const uint8_t* bases, unsigned lower, char* out)
+{
+  static const uint8_t spread[16] = { 0, 0, 0, 0, 1, 1, 1, 1,
+                                      2, 2, 2, 2, 3, 3, 3, 3 };
+  uint32_t word;
+  memcpy(&word, bases, sizeof(word));
+  uint8x16_t v = vqtbl1q_u8(vreinterpretq_u8_u32(vdupq_n_u32(word)),
+                            vld1q_u8(spread));
+  const uint8x16_t field = vreinterpretq_u8_u32(vdupq_n_u32(0xC0300C03u));
+  uint8x16_t m = vandq_u8(v, field);
+  uint8x16_t c =
+      vceqq_u8(m, vreinterpretq_u8_u32(vdupq_n_u32(0x40100401u)));
+  uint8x16_t g =
+      vceqq_u8(m, vreinterpretq_u8_u32(vdupq_n_u32(0x80200802u)));
+  uint8x16_t t = vceqq_u8(m, field);
+  uint8x16_t x = vdupq_n_u8('A');
+  x = vaddq_u8(x, vandq_u8(c, vdupq_n_u8('C' - 'A')));
+  x = vaddq_u8(x, vandq_u8(g, vdupq_n_u8('G' - 'A')));
+  x = vaddq_u8(x, vandq_u8(t, vdupq_n_u8('T' - 'A')));
+  uint8x16_t bits = vcombine_u8(vdup_n_u8((uint8_t)(lower & 0xFF)),
+                                vdup_n_u8((uint8_t)((lower >> 8) & 0xFF)));
+  uint8x16_t isLower = vtstq_u8(bits, vld1q_u8(packBit));
+  x = vorrq_u8(x, vandq_u8(isLower, vdupq_n_u8(0x20)));
+  vst1q_u8((uint8_t*)out, x);
+}
+#endif
+
+bool
+seqioPackAppend(seqioPacked* packed, const char* sequence, size_t length)
+{
+  if (!packedReserve(packed, packed->length + length)) {
+    return false;
+  }
+  size_t i = 0;
+  while (i < length) {
+#if defined(SEQIO_SSE2) || defined(SEQIO_NEON)
+    // blocks start on a mask half word, a block holding an N or other
+    // exception is packed one base at a time below
+    uint32_t bases, lower;
+    size_t n = packed->length;
+    if (n % 16 == 0 && length - i >= 16
+        && packBlock16(sequence + i, &bases, &lower)) {
+      memcpy(packed->bases + n / 4, &bases, sizeof(bases));
+      if (n % 64 == 0) {
+        packed->mask[n / 64] = lower;
+      } else {
+        packed->mask[n / 64] |= (uint64_t)lower << (n % 64);
       }
+      packed->length += 16;
+      i += 16;
+      continue;
+    }
+#endif
+    if (!packOne(packed, sequence[i])) {
+      return false;
     }
+    i++;
   }
-  sf->record = (seqioRecord*)record;
-  record->sequence->data[record->sequence->length] = '\0';
-  seqioTell(sf);
-  return record;
+  return true;
 }
 
-seqioRecord*
-seqioReadFastq(seqioFile* sf, seqioRecord* record)
+bool
+seqioPack(seqioPacked* packed, const char* sequence, size_t length)
 {
-  if (sf->pravite.isEOF && sf->buffer.left == 0) {
-    if (sf->pravite.options->freeRecordOnEOF) {
-      seqioFreeRecord(record);
+  seqioPackedClear(packed);
+  return seqioPackAppend(packed, sequence, length);
+}
+
+// Pack the sequences of every record of a batch one after another, record
+// i starts after the lengths of the records before it.
+bool
+seqioPackBatch(seqioPacked* packed, seqioBatch* batch)
+{
+  seqioPackedClear(packed);
+  for (size_t i = 0; i < batch->count; i++) {
+    seqioSlice slice = batch->sequence[i];
+    if (!seqioPackAppend(packed, batch->data + slice.offset, slice.length)) {
+      return false;
     }
-    sf->record = NULL;
-    sf->fileStats.fileOffset = sf->fileStats.fileSize;
-    return NULL;
   }
-  ensureFastqRecord(sf, "Cannot read fastq record from a fasta file.");
-  if (record == NULL) {
-    record = seqioMalloc(sizeof(seqioRecord));
-    if (record == NULL) {
-      return NULL;
+  return true;
+}
+
+static inline char
+unpackOne(seqioPacked* packed, size_t i)
+{
+  static const char acgt[4] = { 'A', 'C', 'G', 'T' };
+  char c = acgt[(packed->bases[i / 4] >> (2 * (i % 4))) & 3];
+  if ((packed->mask[i / 64] >> (i % 64)) & 1) {
+    c |= 0x20;
+  }
+  return c;
+}
+
+// Write bases [start, start + length) as text to out, which is not
+// NUL-terminated.
+void
+seqioUnpack(seqioPacked* packed, size_t start, size_t length, char* out)
+{
+  size_t end = start + length;
+  if (end > packed->length) {
+    end = packed->length;
+  }
+  if (start >= end) {
+    return;
+  }
+  size_t i = start;
+#if defined(SEQIO_SSE2) || defined(SEQIO_NEON)
+  for (; i < end && i % 16; i++) {
+    out[i - start] = unpackOne(packed, i);
+  }
+  for (; i + 16 <= end; i += 16) {
+    unsigned lower = (unsigned)(packed->mask[i / 64] >> (i % 64)) & 0xFFFF;
+    unpackBlock16(packed->bases + i / 4, lower, out + i - start);
+  }
+#endif
+  for (; i < end; i++) {
+    out[i - start] = unpackOne(packed, i);
+  }
+  // the first run that ends after start
+  seqioPackedRun* runs = packed->exceptions;
+  size_t lo = 0, hi = packed->exceptionCount;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (runs[mid].offset + runs[mid].length <= start) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
     }
-    record->type = seqioRecordTypeFastq;
-    record->name = seqioStringNew(128);
-    record->comment = seqioStringNew(128);
-    record->sequence = seqioStringNew(256);
-    record->quality = seqioStringNew(256);
-  } else {
-    record->type = seqioRecordTypeFastq;
-    seqioStringClear(record->name);
-    seqioStringClear(record->comment);
-    seqioStringClear(record->sequence);
-    seqioStringClear(record->quality);
   }
-  readStatus status = sf->pravite.state;
-  int c;
-  while (1) {
-    size_t readSize = readDataToBuffer(sf);
-    if (readSize == 0) {
-      break;
+  for (size_t r = lo; r < packed->exceptionCount && runs[r].offset < end;
+       r++) {
+    size_t from = runs[r].offset > start ? runs[r].offset : start;
+    size_t to = runs[r].offset + runs[r].length;
+    if (to > end) {
+      to = end;
     }
-    char* buff = sf->buffer.data + sf->buffer.offset;
-    for (size_t i = 0; i < readSize; i++) {
-      c = buff[i];
-      forwardBufferOne(sf);
-      if (c == '\r') {
-        continue;
-      }
-      switch (status) {
-      case READ_STATUS_NONE: {
-        if (c == '@') {
-          status = READ_STATUS_NAME;
-          // Use optimized batch reading for name
-          char delim = readUntilEither(sf, record->name, ' ', '\n');
-          record->name->data[record->name->length] = '\0';
-          if (delim == ' ') {
-            status = READ_STATUS_COMMENT;
-            // Use optimized batch reading for comment
-            delim = readUntilEither(sf, record->comment, '\n', '\n');
-            record->comment->data[record->comment->length] = '\0';
-            status = READ_STATUS_SEQUENCE;
-          } else if (delim == '\n') {
-            status = READ_STATUS_SEQUENCE;
-          }
-          // Now read sequence
-          if (status == READ_STATUS_SEQUENCE) {
-            readUntil(sf, record->sequence, '+', READ_STATUS_ADD);
-            record->sequence->data[record->sequence->length] = '\0';
-            status = READ_STATUS_ADD;
-            // Skip the '+' line
-            while (1) {
-              readSize = readDataToBuffer(sf);
-              if (readSize == 0) break;
-              buff = sf->buffer.data + sf->buffer.offset;
-              for (size_t j = 0; j < sf->buffer.left; j++) {
-                forwardBufferOne(sf);
-                if (buff[j] == '\n') {
-                  status = READ_STATUS_QUALITY;
-                  goto read_quality;
-                }
-              }
-            }
-read_quality:
-            if (status == READ_STATUS_QUALITY) {
-              readUntil(sf, record->quality, '@', READ_STATUS_NAME);
-              record->quality->data[record->quality->length] = '\0';
-              sf->record = (seqioRecord*)record;
-              seqioTell(sf);
-              return record;
-            }
-          }
-        }
-        break;
-      }
-      case READ_STATUS_NAME: {
-        // Fallback for character-by-character reading
-        if (c == ' ') {
-          status = READ_STATUS_COMMENT;
-          record->name->data[record->name->length] = '\0';
-        } else if (c == '\n') {
-          status = READ_STATUS_SEQUENCE;
-          record->name->data[record->name->length] = '\0';
-        } else {
-          seqioStringAppendChar(record->name, c);
-        }
-        break;
-      }
-      case READ_STATUS_COMMENT: {
-        // Fallback for character-by-character reading
-        if (c == '\n') {
-          status = READ_STATUS_SEQUENCE;
-          record->comment->data[record->comment->length] = '\0';
-        } else {
-          seqioStringAppendChar(record->comment, c);
-        }
-        break;
-      }
-      case READ_STATUS_SEQUENCE: {
-        backwardBufferOne(sf);
-        readUntil(sf, record->sequence, '+', READ_STATUS_ADD);
-        record->sequence->data[record->sequence->length] = '\0';
-        status = READ_STATUS_ADD;
-        backwardBufferOne(sf); // back to '+' line
-        // update i, readSize and buff for next loop
-        i = 0;
-        buff = sf->buffer.data + sf->buffer.offset;
-        readSize = sf->buffer.left;
-        break;
-      }
-      case READ_STATUS_ADD: {
-        if (c == '\n') {
-          status = READ_STATUS_QUALITY;
-        }
-        break;
-      }
-      case READ_STATUS_QUALITY: {
-        backwardBufferOne(sf);
-        readUntil(sf, record->quality, '@', READ_STATUS_NAME);
-        record->quality->data[record->quality->length] = '\0';
-        sf->record = (seqioRecord*)record;
-        seqioTell(sf);
-        return record;
-      }
-      default: {
-        break;
-      }
+    for (size_t j = from; j < to; j++) {
+      char c = runs[r].base;
+      if ((packed->mask[j / 64] >> (j % 64)) & 1) {
+        c |= 0x20;
       }
+      out[j - start] = c;
     }
   }
-  sf->record = (seqioRecord*)record;
-  record->quality->data[record->quality->length] = '\0';
-  seqioTell(sf);
-  return record;
 }
 
+// Read the next record and pack its sequence. A streamed FASTA file is
+// packed chunk by chunk while it is parsed and the sequence of the record
+// is left empty, so a chromosome never sits in memory as text.
 seqioRecord*
-seqioRead(seqioFile* sf, seqioRecord* record)
+seqioReadPacked(seqioFile* sf, seqioRecord* record, seqioPacked* packed)
 {
-  if (sf->pravite.isEOF && sf->buffer.left == 0) {
-    if (sf->pravite.options->freeRecordOnEOF) {
-      seqioFreeRecord(record);
+  seqioPackedClear(packed);
+  bool packedOk = true;
+  if (sf->pravite.type == seqioRecordTypeFasta && sf->mapping.data == NULL) {
+    record = seqioReadHeader(sf, record);
+    if (record == NULL) {
+      return NULL;
     }
-    sf->record = NULL;
-    return NULL;
+    char chunk[4096];
+    size_t n;
+    while (packedOk
+           && (n = seqioReadSequence(sf, chunk, sizeof(chunk))) > 0) {
+      packedOk = seqioPackAppend(packed, chunk, n);
+    }
+  } else {
+    record = seqioRead(sf, record);
+    if (record == NULL) {
+      return NULL;
+    }
+    packedOk =
+        seqioPack(packed, record->sequence->data, record->sequence->length);
   }
-  if (sf->pravite.type == seqioRecordTypeFasta) {
-    return seqioReadFasta(sf, record);
-  } else if (sf->pravite.type == seqioRecordTypeFastq) {
-    return seqioReadFastq(sf, record);
+  if (!packedOk) {
+    fprintf(stderr, "Failed to grow the packed sequence.\n");
+    exit(1);
+  }
+  return record;
+}
+
+// 2-bit code plus one of A, C, G and T in either case, 0 for anything else.
+static const uint8_t kmerCode[256] = {
+  ['A'] = 1, ['C'] = 2, ['G'] = 3, ['T'] = 4,
+  ['a'] = 1, ['c'] = 2, ['g'] = 3, ['t'] = 4,
+};
+
+// Write every k-mer of the sequence to kmers, rolling the forward code and
+// the reverse complement in one pass. With canonical the smaller of the two
+// is kept. Windows holding a base other than A, C, G or T are skipped, so
+// positions, when not NULL, gets the start of each k-mer. Both arrays need
+// room for length - k + 1 entries. Returns the number of k-mers, 0 when k
+// is not in [1, 32].
+size_t
+seqioKmers(const char* sequence,
+           size_t length,
+           int k,
+           bool canonical,
+           uint64_t* kmers,
+           size_t* positions)
+{
+  if (k < 1 || k > 32 || length < (size_t)k) {
+    return 0;
+  }
+  uint64_t mask = k == 32 ? ~(uint64_t)0 : ((uint64_t)1 << (2 * k)) - 1;
+  // all ones when the reverse complement may be picked, the pick is done
+  // with masks as it is a coin flip on real data
+  uint64_t pick = canonical ? ~(uint64_t)0 : 0;
+  int shift = 2 * (k - 1);
+  uint64_t forward = 0, reverse = 0;
+  size_t valid = 0, count = 0;
+  for (size_t i = 0; i < length; i++) {
+    uint64_t code = kmerCode[(uint8_t)sequence[i]];
+    if (code == 0) {
+      valid = 0;
+      continue;
+    }
+    code--;
+    forward = ((forward << 2) | code) & mask;
+    reverse = (reverse >> 2) | ((3 - code) << shift);
+    if (++valid < (size_t)k) {
+      continue;
+    }
+    uint64_t smaller = -(uint64_t)(reverse < forward) & pick;
+    kmers[count] = forward ^ ((forward ^ reverse) & smaller);
+    if (positions) {
+      positions[count] = i + 1 - k;
+    }
+    count++;
+  }
+  return count;
+}
+
+// seqioKmers for k up to 64, the codes are rolled across two words.
+size_t
+seqioKmers128(const char* sequence,
+              size_t length,
+              int k,
+              bool canonical,
+              seqioKmer128* kmers,
+              size_t* positions)
+{
+  if (k < 1 || k > 64 || length < (size_t)k) {
+    return 0;
+  }
+  int bits = 2 * k;
+  seqioKmer128 mask = { 0, ~(uint64_t)0 };
+  if (bits < 64) {
+    mask.lo = ((uint64_t)1 << bits) - 1;
+  } else if (bits < 128) {
+    mask.hi = ((uint64_t)1 << (bits - 64)) - 1;
   } else {
-    return NULL;
+    mask.hi = ~(uint64_t)0;
+  }
+  uint64_t pick = canonical ? ~(uint64_t)0 : 0;
+  int shift = bits - 2;
+  seqioKmer128 forward = { 0, 0 }, reverse = { 0, 0 };
+  size_t valid = 0, count = 0;
+  for (size_t i = 0; i < length; i++) {
+    uint64_t code = kmerCode[(uint8_t)sequence[i]];
+    if (code == 0) {
+      valid = 0;
+      continue;
+    }
+    code--;
+    forward.hi = ((forward.hi << 2) | (forward.lo >> 62)) & mask.hi;
+    forward.lo = ((forward.lo << 2) | code) & mask.lo;
+    reverse.lo = (reverse.lo >> 2) | (reverse.hi << 62);
+    reverse.hi >>= 2;
+    if (shift >= 64) {
+      reverse.hi |= (3 - code) << (shift - 64);
+    } else {
+      reverse.lo |= (3 - code) << shift;
+    }
+    if (++valid < (size_t)k) {
+      continue;
+    }
+    uint64_t smaller =
+        -(uint64_t)((reverse.hi < forward.hi)
+                    | ((reverse.hi == forward.hi) & (reverse.lo < forward.lo)))
+        & pick;
+    kmers[count].hi = forward.hi ^ ((forward.hi ^ reverse.hi) & smaller);
+    kmers[count].lo = forward.lo ^ ((forward.lo ^ reverse.lo) & smaller);
+    if (positions) {
+      positions[count] = i + 1 - k;
+    }
+    count++;
   }
+  return count;
 }
 
-static inline seqioString*
-seqioStringUpper(seqioString* string)
+static inline uint64_t
+kmerMask(int k)
 {
-  for (size_t i = 0; i < string->length; i++) {
-    string->data[i] &= 0xDF;
+  return k == 32 ? ~(uint64_t)0 : ((uint64_t)1 << (2 * k)) - 1;
+}
+
+// Thomas Wang's 64-bit integer hash cut to 2k bits. Every step is a
+// multiplication by an odd number or a xor-shift, so it is a bijection on
+// k-mers and seqioKmerUnhash gives the k-mer back.
+uint64_t
+seqioKmerHash(uint64_t kmer, int k)
+{
+  uint64_t mask = kmerMask(k);
+  uint64_t key = (~kmer + (kmer << 21)) & mask;
+  key = key ^ key >> 24;
+  key = (key + (key << 3) + (key << 8)) & mask;
+  key = key ^ key >> 14;
+  key = (key + (key << 2) + (key << 4)) & mask;
+  key = key ^ key >> 28;
+  key = (key + (key << 31)) & mask;
+  return key;
+}
+
+// inverse of an odd number modulo 2^64 by Newton's iteration
+static inline uint64_t
+inverseOdd(uint64_t a)
+{
+  uint64_t x = a;
+  for (int i = 0; i < 5; i++) {
+    x *= 2 - a * x;
   }
-  return string;
+  return x;
 }
 
-static inline seqioString*
-seqioStringLower(seqioString* string)
+static inline uint64_t
+unxorShift(uint64_t y, int shift)
 {
-  for (size_t i = 0; i < string->length; i++) {
-    string->data[i] |= 0x20;
+  uint64_t x = y;
+  for (int i = shift; i < 64; i += shift) {
+    x = y ^ (x >> shift);
   }
-  return string;
+  return x;
 }
 
-void
-seqioWriteFasta(seqioFile* sf, seqioRecord* record, seqioWriteOptions* options)
+uint64_t
+seqioKmerUnhash(uint64_t hash, int k)
 {
-  ensureWriteable(sf);
-  if (!options) {
-    options = &defaultWriteOptions;
+  uint64_t mask = kmerMask(k);
+  uint64_t key = (hash * inverseOdd(((uint64_t)1 << 31) + 1)) & mask;
+  key = unxorShift(key, 28);
+  key = (key * inverseOdd(21)) & mask;
+  key = unxorShift(key, 14);
+  key = (key * inverseOdd(265)) & mask;
+  key = unxorShift(key, 24);
+  return ((key + 1) * inverseOdd(((uint64_t)1 << 21) - 1)) & mask;
+}
+
+// Rolls the canonical code of the last k bases, valid counts the bases
+// since the last one that is not A, C, G or T.
+typedef struct {
+  int k;
+  int shift;
+  uint64_t mask;
+  uint64_t forward;
+  uint64_t reverse;
+  size_t valid;
+} kmerRoller;
+
+static inline void
+kmerRollerInit(kmerRoller* roller, int k)
+{
+  roller->k = k;
+  roller->shift = 2 * (k - 1);
+  roller->mask = kmerMask(k);
+  roller->forward = 0;
+  roller->reverse = 0;
+  roller->valid = 0;
+}
+
+// Add one base, true when the last k bases make a k-mer.
+static inline bool
+kmerRoll(kmerRoller* roller, char c, uint64_t* kmer)
+{
+  uint64_t code = kmerCode[(uint8_t)c];
+  if (code == 0) {
+    roller->valid = 0;
+    return false;
   }
-  if (sf->pravite.type == seqioRecordTypeUnknown) {
-    sf->pravite.type = seqioRecordTypeFasta;
+  code--;
+  roller->forward = ((roller->forward << 2) | code) & roller->mask;
+  roller->reverse = (roller->reverse >> 2) | ((3 - code) << roller->shift);
+  if (++roller->valid < (size_t)roller->k) {
+    return false;
   }
-  // write name
-  writeDataToBuffer(sf, ">", 1);
-  writeDataToBuffer(sf, record->name->data, record->name->length);
-  // write comment
-  if (options->includeComment && record->comment->length) {
-    writeDataToBuffer(sf, " ", 1);
-    writeDataToBuffer(sf, record->comment->data, record->comment->length);
+  uint64_t smaller = -(uint64_t)(roller->reverse < roller->forward);
+  *kmer = roller->forward ^ ((roller->forward ^ roller->reverse) & smaller);
+  return true;
+}
+
+typedef struct {
+  uint64_t hash;
+  size_t position;
+} sketchHit;
+
+// Sliding window minimum over consecutive positions. The deque keeps the
+// hits that can still be the minimum, hashes increasing from head to tail,
+// in a ring of seqioMaxMinimizerWindow entries.
+typedef struct {
+  sketchHit hits[seqioMaxMinimizerWindow];
+  size_t head;
+  size_t tail;
+} sketchWindow;
+
+static inline void
+sketchWindowPush(sketchWindow* window, size_t width, sketchHit hit)
+{
+  const size_t ring = seqioMaxMinimizerWindow - 1;
+  // drop the hit leaving the window first, so at most width are kept
+  if (window->tail > window->head
+      && window->hits[window->head & ring].position + width <= hit.position) {
+    window->head++;
   }
-  writeDataToBuffer(sf, "\n", 1);
-  // write sequence
-  if (options->baseCase == seqioBaseCaseLower) {
-    seqioStringLower(record->sequence);
-  } else if (options->baseCase == seqioBaseCaseUpper) {
-    seqioStringUpper(record->sequence);
+  // ties keep the leftmost hit
+  while (window->tail > window->head
+         && window->hits[(window->tail - 1) & ring].hash > hit.hash) {
+    window->tail--;
   }
-  if (options->lineWidth == 0) {
-    writeDataToBuffer(sf, record->sequence->data, record->sequence->length);
-    writeDataToBuffer(sf, "\n", 1);
-  } else {
-    size_t sequenceLength = record->sequence->length;
-    size_t sequenceOffset = 0;
-    while (sequenceLength) {
-      if (sequenceLength >= options->lineWidth) {
-        writeDataToBuffer(sf, record->sequence->data + sequenceOffset,
-                          options->lineWidth);
-        writeDataToBuffer(sf, "\n", 1);
-        sequenceOffset += options->lineWidth;
-        sequenceLength -= options->lineWidth;
-      } else {
-        writeDataToBuffer(sf, record->sequence->data + sequenceOffset,
-                          sequenceLength);
-        writeDataToBuffer(sf, "\n", 1);
-        break;
+  window->hits[window->tail++ & ring] = hit;
+}
+
+static inline sketchHit
+sketchWindowMin(sketchWindow* window)
+{
+  return window->hits[window->head & (seqioMaxMinimizerWindow - 1)];
+}
+
+// Write the (w, k) minimizers of the sequence: the smallest canonical
+// k-mer hash of every w consecutive k-mers, each written once. Windows
+// holding a base other than A, C, G or T are skipped. Both arrays need room
+// for length - k + 1 entries, positions may be NULL. Returns the number of
+// minimizers, 0 when k is not in [1, 32] or w not in [1, 256].
+size_t
+seqioMinimizers(const char* sequence,
+                size_t length,
+                int k,
+                int w,
+                uint64_t* hashes,
+                size_t* positions)
+{
+  if (k < 1 || k > 32 || w < 1 || w > seqioMaxMinimizerWindow) {
+    return 0;
+  }
+  kmerRoller roller;
+  kmerRollerInit(&roller, k);
+  sketchWindow window = { .head = 0, .tail = 0 };
+  size_t run = 0, count = 0, last = SIZE_MAX;
+  for (size_t i = 0; i < length; i++) {
+    uint64_t kmer;
+    if (!kmerRoll(&roller, sequence[i], &kmer)) {
+      if (roller.valid == 0) {
+        window.head = window.tail = 0;
+        run = 0;
+      }
+      continue;
+    }
+    sketchHit hit = { seqioKmerHash(kmer, k), i + 1 - k };
+    sketchWindowPush(&window, w, hit);
+    if (++run < (size_t)w) {
+      continue;
+    }
+    sketchHit min = sketchWindowMin(&window);
+    if (min.position != last) {
+      last = min.position;
+      hashes[count] = min.hash;
+      if (positions) {
+        positions[count] = min.position;
       }
+      count++;
     }
   }
+  return count;
 }
 
-void
-seqioWriteFastq(seqioFile* sf, seqioRecord* record, seqioWriteOptions* options)
+// Write the syncmers of the sequence, the canonical k-mers whose smallest
+// s-mer hash sits at offset for open syncmers, or at the first or the last
+// s-mer for closed ones. Hashes are seqioKmerHash of the k-mers, arrays and
+// the return value are as for seqioMinimizers. Returns 0 when k is not in
+// [1, 32], s not in [1, k] or offset not in [0, k - s].
+size_t
+seqioSyncmers(const char* sequence,
+              size_t length,
+              int k,
+              int s,
+              seqioSyncmerType type,
+              int offset,
+              uint64_t* hashes,
+              size_t* positions)
 {
-  ensureWriteable(sf);
-  if (!options) {
-    options = &defaultWriteOptions;
-  }
-  if (sf->pravite.type == seqioRecordTypeUnknown) {
-    sf->pravite.type = seqioRecordTypeFastq;
+  if (k < 1 || k > 32 || s < 1 || s > k) {
+    return 0;
   }
-  // write name
-  writeDataToBuffer(sf, "@", 1);
-  writeDataToBuffer(sf, record->name->data, record->name->length);
-  // write comment
-  if (options->includeComment && record->comment->length) {
-    writeDataToBuffer(sf, " ", 1);
-    writeDataToBuffer(sf, record->comment->data, record->comment->length);
+  int smers = k - s + 1;
+  if (type == seqioSyncmerOpen && (offset < 0 || offset >= smers)) {
+    return 0;
   }
-  writeDataToBuffer(sf, "\n", 1);
-  // write sequence
-  if (options->baseCase == seqioBaseCaseLower) {
-    seqioStringLower(record->sequence);
-  } else if (options->baseCase == seqioBaseCaseUpper) {
-    seqioStringUpper(record->sequence);
+  kmerRoller kmers, smerRoller;
+  kmerRollerInit(&kmers, k);
+  kmerRollerInit(&smerRoller, s);
+  sketchWindow window = { .head = 0, .tail = 0 };
+  size_t count = 0;
+  for (size_t i = 0; i < length; i++) {
+    uint64_t kmer, smer;
+    bool kmerReady = kmerRoll(&kmers, sequence[i], &kmer);
+    if (!kmerRoll(&smerRoller, sequence[i], &smer)) {
+      if (smerRoller.valid == 0) {
+        window.head = window.tail = 0;
+      }
+      continue;
+    }
+    sketchHit hit = { seqioKmerHash(smer, s), i + 1 - s };
+    sketchWindowPush(&window, smers, hit);
+    if (!kmerReady) {
+      continue;
+    }
+    size_t start = i + 1 - k;
+    int at = (int)(sketchWindowMin(&window).position - start);
+    bool keep = type == seqioSyncmerClosed ? at == 0 || at == smers - 1
+                                           : at == offset;
+    if (keep) {
+      hashes[count] = seqioKmerHash(kmer, k);
+      if (positions) {
+        positions[count] = start;
+      }
+      count++;
+    }
   }
-  writeDataToBuffer(sf, record->sequence->data, record->sequence->length);
-  // write add
-  writeDataToBuffer(sf, "\n+\n", 3);
-  // write quality
-  writeDataToBuffer(sf, record->quality->data, record->quality->length);
-  writeDataToBuffer(sf, "\n", 1);
+  return count;
 }
@@ -15,10 +15,26 @@
 #define seqioDefaultincludeComment true
 #define seqioDefaultBufferSize 1024l * 16l
 #define seqioDefaultWriteBufferSize 1024l * 128l
+#define seqioReadAheadBufferSize 1024l * 1024l * 4l
+#define seqioReadAheadSlots 4
+#define seqioParallelChunkSize 1024l * 1024l * 8l
+#define seqioPipelineBatchRecords 4096
+#define seqioPipelineBatchBytes 1024l * 1024l * 4l
+#define seqioDefaultArenaBlockSize 1024l * 1024l
+#define seqioDefaultPoolBlockSize 256
+#define seqioDefaultPoolBlocksPerChunk 1024
+// largest minimizer window, in k-mers
+#define seqioMaxMinimizerWindow 256
 
-#ifndef seqioAlloc
+// each of these can be defined before including seqio.h to replace the
+// allocator used at build time
+#ifndef seqioMalloc
 #define seqioMalloc(size) malloc(size)
+#endif
+#ifndef seqioRealloc
 #define seqioRealloc(ptr, size) realloc(ptr, size)
+#endif
+#ifndef seqioFree
 #define seqioFree(ptr) free(ptr)
 #endif
 
@@ -26,6 +42,19 @@
 extern "C" {
 #endif
 
+// Allocator for records and batches chosen at run time. Sizes are handed
+// back to resize and release, so arenas and pools need no block headers.
+// A NULL allocator means seqioMalloc, seqioRealloc and seqioFree.
+typedef struct {
+  void* (*alloc)(void* context, size_t size);
+  void* (*resize)(void* context, void* ptr, size_t oldSize, size_t size);
+  void (*release)(void* context, void* ptr, size_t size);
+  void* context;
+  // release does nothing and memory only goes back all at once, as with an
+  // arena, so records may already be gone when the file is closed
+  bool bulkRelease;
+} seqioAllocator;
+
 typedef enum {
   seqioRecordTypeFasta,
   seqioRecordTypeFastq,
@@ -36,6 +65,8 @@ typedef struct {
   char* data;
   size_t length;
   size_t capacity;
+  // where data came from when capacity is not 0
+  seqioAllocator* allocator;
 } seqioString;
 
 typedef struct {
@@ -44,6 +75,7 @@ typedef struct {
   seqioString* comment;
   seqioString* sequence;
   seqioString* quality;
+  seqioAllocator* allocator;
 } seqioRecord;
 
 typedef enum {
@@ -51,11 +83,46 @@ typedef enum {
   seqOpenModeWrite,
 } seqOpenMode;
 
+typedef enum {
+  seqioStrategyDefault,
+  seqioStrategyFiltered,
+  seqioStrategyHuffmanOnly,
+  seqioStrategyRle,
+  seqioStrategyFixed,
+} seqioCompressionStrategy;
+
+typedef enum {
+  // write buffers out as they fill, flush only on seqioFlush and seqioClose
+  seqioFlushOnClose,
+  // also flush after every buffer, output survives a crash up to the last
+  // buffer at the cost of compression ratio and a syscall per buffer
+  seqioFlushEveryBuffer,
+} seqioFlushPolicy;
+
 typedef struct {
   const char* filename;
   bool isGzipped;
   seqOpenMode mode;
   bool freeRecordOnEOF;
+  // map plain input files into memory and return records whose fields are
+  // views into the mapping, such fields are read-only, not NUL-terminated
+  // and stay valid until the next read or seqioClose
+  bool zeroCopy;
+  // read and inflate on a background thread into a ring of large buffers
+  // while records are parsed from the previous one
+  bool readAhead;
+  // inflate BGZF input or deflate BGZF output on this many threads, 0 or 1
+  // does it on the calling thread
+  int threads;
+  // write BGZF, independently compressed blocks of at most 64 KB
+  bool bgzf;
+  // 1-9 for gzipped output, 0 keeps zlib's default of 6
+  int compressionLevel;
+  seqioCompressionStrategy compressionStrategy;
+  seqioFlushPolicy flushPolicy;
+  // records seqioRead allocates, and their fields, come from here. The
+  // buffers of the file itself live as long as the file and do not.
+  seqioAllocator* allocator;
 } seqioOpenOptions;
 
 typedef enum {
@@ -70,6 +137,106 @@ typedef struct {
   baseCase baseCase;
 } seqioWriteOptions;
 
+// a field of a batched record, offset and length into the batch arena
+typedef struct {
+  size_t offset;
+  size_t length;
+} seqioSlice;
+
+// Records stored as arrays of slices over one contiguous arena, record i
+// is made of name[i], comment[i], sequence[i] and quality[i]. Every field
+// is followed by a NUL in the arena which its length does not count.
+typedef struct {
+  seqioRecordType type;
+  size_t count;
+  size_t capacity;
+  char* data;
+  size_t size;
+  size_t dataCapacity;
+  seqioSlice* name;
+  seqioSlice* comment;
+  seqioSlice* sequence;
+  seqioSlice* quality;
+  seqioAllocator* allocator;
+} seqioBatch;
+
+// A run of bases that are not A, C, G or T, e.g. N, packed as A.
+typedef struct {
+  size_t offset;
+  size_t length;
+  char base;
+} seqioPackedRun;
+
+// Sequence at 2 bits per base, base i is in bits 2 * (i % 4) of
+// bases[i / 4] with A, C, G and T as 0 to 3. Bit i % 64 of mask[i / 64] is
+// set when base i was lower case, exceptions are sorted by offset.
+typedef struct {
+  uint8_t* bases;
+  uint64_t* mask;
+  size_t length;
+  size_t capacity;
+  seqioPackedRun* exceptions;
+  size_t exceptionCount;
+  size_t exceptionCapacity;
+} seqioPacked;
+
+// A 2-bit k-mer of up to 64 bases, the first base is in the high bits of
+// hi and the last one in the low bits of lo.
+typedef struct {
+  uint64_t hi;
+  uint64_t lo;
+} seqioKmer128;
+
+typedef enum {
+  // the smallest s-mer is at a given offset in the k-mer
+  seqioSyncmerOpen,
+  // the smallest s-mer is the first or the last one of the k-mer
+  seqioSyncmerClosed,
+} seqioSyncmerType;
+
+typedef void (*seqioBatchCallback)(seqioBatch* batch, void* userData);
+
+typedef struct {
+  const char* filename;
+  int threads;
+  // bytes of input parsed into one batch, 0 uses seqioParallelChunkSize
+  size_t chunkSize;
+  // hand batches to the callback in file order and one at a time,
+  // otherwise the callback runs concurrently on every worker
+  bool ordered;
+  seqioBatchCallback callback;
+  void* userData;
+} seqioParallelOptions;
+
+// one line of a .fai, offset is where the sequence starts in the file
+typedef struct {
+  char* name;
+  size_t length;
+  size_t offset;
+  size_t lineBases;
+  size_t lineWidth;
+} seqioIndexEntry;
+
+typedef struct {
+  seqioIndexEntry* entries;
+  size_t count;
+  size_t capacity;
+  // the entries sorted by name, for lookups
+  seqioIndexEntry** sorted;
+} seqioIndex;
+
+// Bump allocator over large blocks. Release only takes back the latest
+// allocation, everything else is dropped at once by seqioArenaReset.
+typedef struct seqioArena seqioArena;
+// Fixed-size blocks kept on a free list, larger requests go to seqioMalloc.
+// Neither is thread safe, give each thread its own.
+typedef struct seqioPool seqioPool;
+typedef struct seqioReadAhead seqioReadAhead;
+typedef struct seqioBgzf seqioBgzf;
+typedef struct seqioPairedFile seqioPairedFile;
+typedef struct seqioGzi seqioGzi;
+typedef struct seqioRecordIndex seqioRecordIndex;
+
 typedef struct {
   seqioRecord* record;
   struct {
@@ -88,14 +255,60 @@ typedef struct {
     seqioOpenOptions* options;
     void* file;
     seqOpenMode mode;
+    seqioReadAhead* readAhead;
+    seqioBgzf* bgzf;
+    // scratch record seqioReadBatch parses into
+    seqioRecord* batchRecord;
+    // loaded by the first seqioFetch
+    seqioIndex* index;
+    seqioGzi* gzi;
+    // loaded by the first seek
+    seqioRecordIndex* recordIndex;
+    FILE* fetchFile;
+    seqioString* fetched;
   } pravite;
+  // for gzipped input the size and offset are measured in compressed bytes
   struct {
     size_t fileSize;
     size_t fileOffset;
+    size_t uncompressedSize;
   } fileStats;
+  struct {
+    char* data;
+    size_t size;
+    // backing storage for multi-line fields that need newline stripping
+    seqioString* sequence;
+    seqioString* quality;
+    // the other pair, seqioReadPair alternates so both mates stay valid
+    seqioString* mateSequence;
+    seqioString* mateQuality;
+  } mapping;
   bool fromFile;
 } seqioFile;
 
+// Turn the records of in into out, out is empty when called and may be
+// left empty to drop the whole batch.
+typedef void (*seqioPipelineCallback)(seqioBatch* in,
+                                      seqioBatch* out,
+                                      void* userData);
+
+typedef struct {
+  seqioFile* reader;
+  seqioFile* writer;
+  // NULL uses the default write options
+  seqioWriteOptions* writeOptions;
+  int threads;
+  // limits of one batch, 0 uses seqioPipelineBatchRecords and
+  // seqioPipelineBatchBytes
+  size_t batchRecords;
+  size_t batchBytes;
+  // batches read but not yet written, this bounds the memory in use,
+  // 0 uses 4 per thread
+  size_t queueDepth;
+  seqioPipelineCallback callback;
+  void* userData;
+} seqioPipelineOptions;
+
 #define defaultSeqioWriteOptions                                              \
   {                                                                           \
     .lineWidth = seqioDefaultLineWidth,                                       \
@@ -112,15 +325,113 @@ void seqioClose(seqioFile* sf);
 void seqioFlush(seqioFile* sf);
 void seqioReset(seqioFile* sf);
 seqioRecordType seqioGuessType(seqioFile* sf);
+size_t seqioUncompressedSize(seqioFile* sf);
 seqioRecord* seqioReadFasta(seqioFile* sf, seqioRecord* record);
 seqioRecord* seqioReadFastq(seqioFile* sf, seqioRecord* record);
 seqioRecord* seqioRead(seqioFile* sf, seqioRecord* record);
+seqioRecord* seqioReadHeader(seqioFile* sf, seqioRecord* record);
+size_t seqioReadSequence(seqioFile* sf, char* buffer, size_t size);
+seqioBatch* seqioBatchNew(size_t records, size_t bytes);
+seqioBatch* seqioBatchNewFrom(seqioAllocator* allocator,
+                              size_t records,
+                              size_t bytes);
+void seqioBatchFree(seqioBatch* batch);
+void seqioBatchClear(seqioBatch* batch);
+bool seqioBatchPush(seqioBatch* batch, seqioRecord* record);
+size_t seqioReadBatch(seqioFile* sf,
+                      seqioBatch* batch,
+                      size_t maxRecords,
+                      size_t maxBytes);
+size_t seqioParallelRead(seqioParallelOptions* options);
 void seqioWriteFasta(seqioFile* sf,
                      seqioRecord* record,
                      seqioWriteOptions* options);
 void seqioWriteFastq(seqioFile* sf,
                      seqioRecord* record,
                      seqioWriteOptions* options);
+void seqioWriteBatch(seqioFile* sf,
+                     seqioBatch* batch,
+                     seqioWriteOptions* options);
+size_t seqioPipelineRun(seqioPipelineOptions* options);
+seqioPairedFile* seqioPairedOpen(seqioOpenOptions* options1,
+                                 seqioOpenOptions* options2);
+void seqioPairedClose(seqioPairedFile* pf);
+bool seqioPairedRead(seqioPairedFile* pf,
+                     seqioRecord** record1,
+                     seqioRecord** record2);
+size_t seqioPairedReadBatch(seqioPairedFile* pf,
+                            seqioBatch** batch1,
+                            seqioBatch** batch2);
+bool seqioReadPair(seqioFile* sf, seqioRecord** record1, seqioRecord** record2);
+void seqioWritePair(seqioFile* sf,
+                    seqioRecord* record1,
+                    seqioRecord* record2,
+                    seqioWriteOptions* options);
+size_t seqioInterleave(seqioPairedFile* pf,
+                       seqioFile* out,
+                       seqioWriteOptions* options);
+size_t seqioDeinterleave(seqioFile* in,
+                         seqioFile* out1,
+                         seqioFile* out2,
+                         seqioWriteOptions* options);
+bool seqioBuildIndex(const char* filename);
+bool seqioBuildGzi(const char* filename);
+seqioIndex* seqioIndexLoad(const char* filename);
+void seqioIndexFree(seqioIndex* index);
+seqioIndexEntry* seqioIndexFind(seqioIndex* index, const char* name);
+seqioString* seqioFetch(seqioFile* sf,
+                        const char* name,
+                        size_t start,
+                        size_t end);
+bool seqioBuildRecordIndex(const char* filename, int threads);
+size_t seqioRecordCount(seqioFile* sf);
+bool seqioSeekRecord(seqioFile* sf, size_t ordinal);
+bool seqioSeekName(seqioFile* sf, const char* name);
+seqioPacked* seqioPackedNew(size_t capacity);
+void seqioPackedFree(seqioPacked* packed);
+void seqioPackedClear(seqioPacked* packed);
+bool seqioPackAppend(seqioPacked* packed, const char* sequence, size_t length);
+bool seqioPack(seqioPacked* packed, const char* sequence, size_t length);
+bool seqioPackBatch(seqioPacked* packed, seqioBatch* batch);
+void seqioUnpack(seqioPacked* packed, size_t start, size_t length, char* out);
+seqioRecord* seqioReadPacked(seqioFile* sf,
+                             seqioRecord* record,
+                             seqioPacked* packed);
+size_t seqioKmers(const char* sequence,
+                  size_t length,
+                  int k,
+                  bool canonical,
+                  uint64_t* kmers,
+                  size_t* positions);
+size_t seqioKmers128(const char* sequence,
+                     size_t length,
+                     int k,
+                     bool canonical,
+                     seqioKmer128* kmers,
+                     size_t* positions);
+uint64_t seqioKmerHash(uint64_t kmer, int k);
+uint64_t seqioKmerUnhash(uint64_t hash, int k);
+size_t seqioMinimizers(const char* sequence,
+                       size_t length,
+                       int k,
+                       int w,
+                       uint64_t* hashes,
+                       size_t* positions);
+size_t seqioSyncmers(const char* sequence,
+                     size_t length,
+                     int k,
+                     int s,
+                     seqioSyncmerType type,
+                     int offset,
+                     uint64_t* hashes,
+                     size_t* positions);
+seqioArena* seqioArenaNew(size_t blockSize);
+void seqioArenaFree(seqioArena* arena);
+void seqioArenaReset(seqioArena* arena);
+seqioAllocator* seqioArenaAllocator(seqioArena* arena);
+seqioPool* seqioPoolNew(size_t blockSize, size_t blocksPerChunk);
+void seqioPoolFree(seqioPool* pool);
+seqioAllocator* seqioPoolAllocator(seqioPool* pool);
 #ifdef __cplusplus
 }
 #endif
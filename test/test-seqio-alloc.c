@@ -0,0 +1,45 @@
+#include "seqio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int
+main(int argc, char* argv[])
+{
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <arena|pool> <in.fasta> [max records]\n",
+            argv[0]);
+    return 1;
+  }
+  seqioArena* arena = NULL;
+  seqioPool* pool = NULL;
+  seqioOpenOptions openOptions = {
+    .filename = argv[2],
+    .mode = seqOpenModeRead,
+    .freeRecordOnEOF = true,
+  };
+  if (strcmp(argv[1], "arena") == 0) {
+    // small blocks so records spill over into new ones
+    arena = seqioArenaNew(512);
+    openOptions.allocator = seqioArenaAllocator(arena);
+  } else {
+    pool = seqioPoolNew(64, 16);
+    openOptions.allocator = seqioPoolAllocator(pool);
+  }
+  seqioFile* sf = seqioOpen(&openOptions);
+  seqioRecord* record = NULL;
+  size_t count = 0;
+  // stopping early leaves the last record to seqioClose
+  size_t max = argc > 3 ? strtoul(argv[3], NULL, 10) : SIZE_MAX;
+  while (count < max && (record = seqioRead(sf, record)) != NULL) {
+    printf("@%s %s\n%s+\n%s\n", record->name->data, record->comment->data,
+           record->sequence->data, record->quality->data);
+    if (++count % 2 == 0 && arena != NULL) {
+      seqioArenaReset(arena);
+      record = NULL;
+    }
+  }
+  seqioClose(sf);
+  seqioArenaFree(arena);
+  seqioPoolFree(pool);
+}
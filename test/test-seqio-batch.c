@@ -0,0 +1,28 @@
+#include "seqio.h"
+#include <stdio.h>
+
+int
+main(int argc, char* argv[])
+{
+  if (argc == 1) {
+    fprintf(stderr, "Usage: %s <in.fasta>\n", argv[0]);
+    return 1;
+  }
+  seqioOpenOptions openOptions = {
+    .filename = argv[1],
+    .mode = seqOpenModeRead,
+  };
+  seqioFile* sf = seqioOpen(&openOptions);
+  // deliberately small so the batch is refilled and its arena regrows
+  seqioBatch* batch = seqioBatchNew(2, 16);
+  while (seqioReadBatch(sf, batch, 2, 0) > 0) {
+    for (size_t i = 0; i < batch->count; i++) {
+      printf("@%s %s\n%s+\n%s\n", batch->data + batch->name[i].offset,
+             batch->data + batch->comment[i].offset,
+             batch->data + batch->sequence[i].offset,
+             batch->data + batch->quality[i].offset);
+    }
+  }
+  seqioBatchFree(batch);
+  seqioClose(sf);
+}
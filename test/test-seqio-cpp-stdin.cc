@@ -9,6 +9,14 @@ read()
     .isGzipped = false,
     .mode = seqOpenModeRead,
     .freeRecordOnEOF = true,
+    .zeroCopy = false,
+    .readAhead = false,
+    .threads = 0,
+    .bgzf = false,
+    .compressionLevel = 0,
+    .compressionStrategy = seqioStrategyDefault,
+    .flushPolicy = seqioFlushOnClose,
+    .allocator = NULL,
   };
   seqioFile* sf = seqioOpen(&openOptions);
   seqioRecord* record = NULL;
@@ -0,0 +1,26 @@
+#include "seqio.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int
+main(int argc, char* argv[])
+{
+  if (argc < 5 || (argc - 2) % 3 != 0) {
+    fprintf(stderr, "Usage: %s <in.fasta> <name> <start> <end> ...\n",
+            argv[0]);
+    return 1;
+  }
+  seqioOpenOptions openOptions = {
+    .filename = argv[1],
+    .mode = seqOpenModeRead,
+  };
+  seqioFile* sf = seqioOpen(&openOptions);
+  for (int i = 2; i < argc; i += 3) {
+    size_t start = strtoul(argv[i + 1], NULL, 10);
+    size_t end = strtoul(argv[i + 2], NULL, 10);
+    seqioString* sequence = seqioFetch(sf, argv[i], start, end);
+    printf("%s:%zu-%zu\t%s\n", argv[i], start, end,
+           sequence ? sequence->data : "(not found)");
+  }
+  seqioClose(sf);
+}
@@ -0,0 +1,80 @@
+#include "seqio.h"
+#include <stdio.h>
+#include <string.h>
+
+static bool
+sameString(seqioString* a, seqioString* b)
+{
+  return a->length == b->length && memcmp(a->data, b->data, a->length) == 0;
+}
+
+static bool
+sameRecord(seqioRecord* a, seqioRecord* b)
+{
+  return sameString(a->name, b->name) && sameString(a->sequence, b->sequence)
+         && sameString(a->quality, b->quality);
+}
+
+// Read an interleaved file with and without zeroCopy, the mates must agree
+// even when their fields are wrapped over several lines.
+static int
+readPairs(const char* filename)
+{
+  seqioOpenOptions options = {
+    .filename = filename,
+    .mode = seqOpenModeRead,
+    .freeRecordOnEOF = true,
+  };
+  seqioFile* buffered = seqioOpen(&options);
+  options.zeroCopy = true;
+  seqioFile* mapped = seqioOpen(&options);
+  seqioFile* out = seqioStdoutOpen();
+  seqioRecord* records[4] = { NULL, NULL, NULL, NULL };
+  size_t pairs = 0;
+  while (seqioReadPair(mapped, &records[0], &records[1])) {
+    if (!seqioReadPair(buffered, &records[2], &records[3])
+        || !sameRecord(records[0], records[2])
+        || !sameRecord(records[1], records[3])) {
+      fprintf(stderr, "zeroCopy pair %zu differs\n", pairs);
+      return 1;
+    }
+    seqioWritePair(out, records[0], records[1], NULL);
+    pairs++;
+  }
+  if (seqioReadPair(buffered, &records[2], &records[3])) {
+    fprintf(stderr, "zeroCopy read ends after %zu pairs\n", pairs);
+    return 1;
+  }
+  seqioClose(out);
+  seqioClose(mapped);
+  seqioClose(buffered);
+  fprintf(stderr, "pairs: %zu\n", pairs);
+  return 0;
+}
+
+int
+main(int argc, char* argv[])
+{
+  if (argc == 2) {
+    return readPairs(argv[1]);
+  }
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <in_1.fastq> <in_2.fastq>\n", argv[0]);
+    fprintf(stderr, "       %s <interleaved.fastq>\n", argv[0]);
+    return 1;
+  }
+  seqioOpenOptions options1 = {
+    .filename = argv[1],
+    .mode = seqOpenModeRead,
+  };
+  seqioOpenOptions options2 = {
+    .filename = argv[2],
+    .mode = seqOpenModeRead,
+  };
+  seqioPairedFile* pf = seqioPairedOpen(&options1, &options2);
+  seqioFile* out = seqioStdoutOpen();
+  size_t pairs = seqioInterleave(pf, out, NULL);
+  seqioClose(out);
+  seqioPairedClose(pf);
+  fprintf(stderr, "pairs: %zu\n", pairs);
+}
@@ -0,0 +1,58 @@
+#include "seqio.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void
+printKmer(uint64_t hi, uint64_t lo, int k)
+{
+  static const char acgt[4] = { 'A', 'C', 'G', 'T' };
+  for (int i = k - 1; i >= 0; i--) {
+    uint64_t word = i >= 32 ? hi : lo;
+    putchar(acgt[(word >> (2 * (i % 32))) & 3]);
+  }
+}
+
+int
+main(int argc, char* argv[])
+{
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <in.fasta> <k>\n", argv[0]);
+    return 1;
+  }
+  int k = atoi(argv[2]);
+  seqioOpenOptions openOptions = {
+    .filename = argv[1],
+    .mode = seqOpenModeRead,
+  };
+  seqioFile* sf = seqioOpen(&openOptions);
+  seqioRecord* record = NULL;
+  // one line per canonical k-mer: record, start and the k-mer as text
+  while ((record = seqioRead(sf, record)) != NULL) {
+    size_t length = record->sequence->length;
+    size_t* positions = malloc(sizeof(size_t) * (length + 1));
+    size_t count;
+    if (k <= 32) {
+      uint64_t* kmers = malloc(sizeof(uint64_t) * (length + 1));
+      count = seqioKmers(record->sequence->data, length, k, true, kmers,
+                         positions);
+      for (size_t i = 0; i < count; i++) {
+        printf("%s\t%zu\t", record->name->data, positions[i]);
+        printKmer(0, kmers[i], k);
+        putchar('\n');
+      }
+      free(kmers);
+    } else {
+      seqioKmer128* kmers = malloc(sizeof(seqioKmer128) * (length + 1));
+      count = seqioKmers128(record->sequence->data, length, k, true, kmers,
+                            positions);
+      for (size_t i = 0; i < count; i++) {
+        printf("%s\t%zu\t", record->name->data, positions[i]);
+        printKmer(kmers[i].hi, kmers[i].lo, k);
+        putchar('\n');
+      }
+      free(kmers);
+    }
+    free(positions);
+  }
+  seqioClose(sf);
+}
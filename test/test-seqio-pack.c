@@ -0,0 +1,31 @@
+#include "seqio.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int
+main(int argc, char* argv[])
+{
+  if (argc == 1) {
+    fprintf(stderr, "Usage: %s <in.fasta>\n", argv[0]);
+    return 1;
+  }
+  seqioOpenOptions openOptions = {
+    .filename = argv[1],
+    .mode = seqOpenModeRead,
+  };
+  seqioFile* sf = seqioOpen(&openOptions);
+  seqioPacked* packed = seqioPackedNew(0);
+  seqioRecord* record = NULL;
+  char* sequence = NULL;
+  // unpacking must give back the text the record was parsed from
+  while ((record = seqioReadPacked(sf, record, packed)) != NULL) {
+    sequence = realloc(sequence, packed->length + 1);
+    seqioUnpack(packed, 0, packed->length, sequence);
+    sequence[packed->length] = '\0';
+    printf("@%s %s\n%s+\n%s\n", record->name->data, record->comment->data,
+           sequence, record->quality->data);
+  }
+  free(sequence);
+  seqioPackedFree(packed);
+  seqioClose(sf);
+}
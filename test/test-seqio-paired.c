@@ -0,0 +1,29 @@
+#include "seqio.h"
+#include <stdio.h>
+
+int
+main(int argc, char* argv[])
+{
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <in_1.fastq> <in_2.fastq>\n", argv[0]);
+    return 1;
+  }
+  seqioOpenOptions options1 = {
+    .filename = argv[1],
+    .mode = seqOpenModeRead,
+  };
+  seqioOpenOptions options2 = {
+    .filename = argv[2],
+    .mode = seqOpenModeRead,
+  };
+  seqioPairedFile* pf = seqioPairedOpen(&options1, &options2);
+  seqioRecord* record1 = NULL;
+  seqioRecord* record2 = NULL;
+  while (seqioPairedRead(pf, &record1, &record2)) {
+    printf("%.*s\t%.*s\t%.*s\n", (int)record1->name->length,
+           record1->name->data, (int)record1->sequence->length,
+           record1->sequence->data, (int)record2->sequence->length,
+           record2->sequence->data);
+  }
+  seqioPairedClose(pf);
+}
@@ -0,0 +1,53 @@
+#include "seqio.h"
+#include <stdio.h>
+
+static void
+printBatch(seqioBatch* batch, void* userData)
+{
+  (void)userData;
+  for (size_t i = 0; i < batch->count; i++) {
+    printf("@%s %s\n%s+\n%s\n", batch->data + batch->name[i].offset,
+           batch->data + batch->comment[i].offset,
+           batch->data + batch->sequence[i].offset,
+           batch->data + batch->quality[i].offset);
+  }
+}
+
+int
+main(int argc, char* argv[])
+{
+  if (argc == 1) {
+    fprintf(stderr, "Usage: %s <in.fasta>\n", argv[0]);
+    return 1;
+  }
+  // tiny chunks so that most records cross a chunk boundary
+  seqioParallelOptions options = {
+    .filename = argv[1],
+    .threads = 3,
+    .chunkSize = 64,
+    .ordered = true,
+    .callback = printBatch,
+    .userData = NULL,
+  };
+  size_t records = seqioParallelRead(&options);
+  fprintf(stderr, "records: %zu\n", records);
+  // every record must be found, wrapped FASTQ included
+  seqioOpenOptions openOptions = {
+    .filename = argv[1],
+    .mode = seqOpenModeRead,
+    .zeroCopy = true,
+    .freeRecordOnEOF = true,
+  };
+  seqioFile* sf = seqioOpen(&openOptions);
+  seqioRecord* record = NULL;
+  size_t expected = 0;
+  while ((record = seqioRead(sf, record)) != NULL) {
+    expected++;
+  }
+  seqioClose(sf);
+  if (records != expected) {
+    fprintf(stderr, "expected %zu records\n", expected);
+    return 1;
+  }
+  return 0;
+}
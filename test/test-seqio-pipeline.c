@@ -0,0 +1,60 @@
+#include "seqio.h"
+#include <stdio.h>
+
+static seqioString
+field(seqioBatch* batch, seqioSlice slice)
+{
+  seqioString s = { batch->data + slice.offset, slice.length, 0, NULL };
+  return s;
+}
+
+// keep the first ten bases of every record
+static void
+trim(seqioBatch* in, seqioBatch* out, void* userData)
+{
+  (void)userData;
+  seqioString name, comment, sequence, quality;
+  seqioRecord record = { in->type, &name, &comment, &sequence, &quality,
+                         NULL };
+  for (size_t i = 0; i < in->count; i++) {
+    name = field(in, in->name[i]);
+    comment = field(in, in->comment[i]);
+    sequence = field(in, in->sequence[i]);
+    quality = field(in, in->quality[i]);
+    sequence.length = sequence.length < 10 ? sequence.length : 10;
+    quality.length = quality.length < 10 ? quality.length : 10;
+    seqioBatchPush(out, &record);
+  }
+}
+
+int
+main(int argc, char* argv[])
+{
+  if (argc == 1) {
+    fprintf(stderr, "Usage: %s <in.fasta>\n", argv[0]);
+    return 1;
+  }
+  seqioOpenOptions openOptions = {
+    .filename = argv[1],
+    .mode = seqOpenModeRead,
+  };
+  seqioFile* reader = seqioOpen(&openOptions);
+  seqioFile* writer = seqioStdoutOpen();
+  seqioWriteOptions writeOptions = defaultSeqioWriteOptions;
+  // two records per batch and a short queue, so the writer has to wait
+  seqioPipelineOptions options = {
+    .reader = reader,
+    .writer = writer,
+    .writeOptions = &writeOptions,
+    .threads = 3,
+    .batchRecords = 2,
+    .batchBytes = 0,
+    .queueDepth = 2,
+    .callback = trim,
+    .userData = NULL,
+  };
+  size_t records = seqioPipelineRun(&options);
+  seqioClose(writer);
+  seqioClose(reader);
+  fprintf(stderr, "records: %zu\n", records);
+}
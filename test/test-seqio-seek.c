@@ -0,0 +1,45 @@
+#include "seqio.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static seqioRecord*
+printNext(seqioFile* sf, seqioRecord* record)
+{
+  record = seqioRead(sf, record);
+  if (record == NULL) {
+    printf("(end of file)\n");
+    return NULL;
+  }
+  printf("@%s %s\n%s+\n%s\n", record->name->data, record->comment->data,
+         record->sequence->data, record->quality->data);
+  return record;
+}
+
+int
+main(int argc, char* argv[])
+{
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <in.fastq> <ordinal|name> ...\n", argv[0]);
+    return 1;
+  }
+  seqioOpenOptions openOptions = {
+    .filename = argv[1],
+    .mode = seqOpenModeRead,
+    .freeRecordOnEOF = true,
+  };
+  seqioFile* sf = seqioOpen(&openOptions);
+  seqioRecord* record = NULL;
+  printf("records: %zu\n", seqioRecordCount(sf));
+  for (int i = 2; i < argc; i++) {
+    char* end;
+    size_t ordinal = strtoul(argv[i], &end, 10);
+    bool found = *end == '\0' ? seqioSeekRecord(sf, ordinal)
+                              : seqioSeekName(sf, argv[i]);
+    if (found) {
+      record = printNext(sf, record);
+    } else {
+      printf("%s not found\n", argv[i]);
+    }
+  }
+  seqioClose(sf);
+}
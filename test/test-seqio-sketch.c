@@ -0,0 +1,55 @@
+#include "seqio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int
+main(int argc, char* argv[])
+{
+  if (argc < 5) {
+    fprintf(stderr,
+            "Usage: %s <in.fasta> <minimizer|open|closed> <k> <w|s> "
+            "[offset]\n",
+            argv[0]);
+    return 1;
+  }
+  const char* sketch = argv[2];
+  int k = atoi(argv[3]);
+  int param = atoi(argv[4]);
+  int offset = argc > 5 ? atoi(argv[5]) : 0;
+  seqioOpenOptions openOptions = {
+    .filename = argv[1],
+    .mode = seqOpenModeRead,
+  };
+  seqioFile* sf = seqioOpen(&openOptions);
+  seqioRecord* record = NULL;
+  // one line per hit: record, start of the k-mer and its hash
+  while ((record = seqioRead(sf, record)) != NULL) {
+    size_t length = record->sequence->length;
+    uint64_t* hashes = malloc(sizeof(uint64_t) * (length + 1));
+    size_t* positions = malloc(sizeof(size_t) * (length + 1));
+    size_t count;
+    if (strcmp(sketch, "minimizer") == 0) {
+      count = seqioMinimizers(record->sequence->data, length, k, param,
+                              hashes, positions);
+    } else {
+      seqioSyncmerType type = strcmp(sketch, "open") == 0
+                                  ? seqioSyncmerOpen
+                                  : seqioSyncmerClosed;
+      count = seqioSyncmers(record->sequence->data, length, k, param, type,
+                            offset, hashes, positions);
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (seqioKmerHash(seqioKmerUnhash(hashes[i], k), k) != hashes[i]) {
+        fprintf(stderr, "hash of %s:%zu does not invert\n",
+                record->name->data, positions[i]);
+        return 1;
+      }
+      printf("%s\t%zu\t%016llx\n", record->name->data, positions[i],
+             (unsigned long long)hashes[i]);
+    }
+    free(hashes);
+    free(positions);
+  }
+  seqioClose(sf);
+}
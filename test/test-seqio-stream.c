@@ -0,0 +1,37 @@
+#include "seqio.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int
+main(int argc, char* argv[])
+{
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <in.fasta> <chunk size> [max chunks]\n",
+            argv[0]);
+    return 1;
+  }
+  size_t size = strtoul(argv[2], NULL, 10);
+  size_t maxChunks = argc > 3 ? strtoul(argv[3], NULL, 10) : 0;
+  char* chunk = malloc(size);
+  seqioOpenOptions openOptions = {
+    .filename = argv[1],
+    .mode = seqOpenModeRead,
+    .freeRecordOnEOF = true,
+  };
+  seqioFile* sf = seqioOpen(&openOptions);
+  seqioRecord* record = NULL;
+  while ((record = seqioReadHeader(sf, record)) != NULL) {
+    printf(">%s %s\n", record->name->data, record->comment->data);
+    size_t chunks = 0, length = 0, n;
+    // a record may be left part way, the next header skips the rest
+    while ((maxChunks == 0 || chunks < maxChunks) &&
+           (n = seqioReadSequence(sf, chunk, size)) > 0) {
+      fwrite(chunk, 1, n, stdout);
+      chunks++;
+      length += n;
+    }
+    printf("\nchunks: %zu, length: %zu\n", chunks, length);
+  }
+  seqioClose(sf);
+  free(chunk);
+}
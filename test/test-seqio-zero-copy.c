@@ -0,0 +1,49 @@
+#include "seqio.h"
+#include <stdio.h>
+#include <string.h>
+
+int
+main(int argc, char* argv[])
+{
+  if (argc == 1) {
+    fprintf(stderr, "Usage: %s <in.fasta> [upper|lower]\n", argv[0]);
+    return 1;
+  }
+  seqioOpenOptions openOptions = {
+    .filename = argv[1],
+    .mode = seqOpenModeRead,
+    .zeroCopy = true,
+  };
+  seqioFile* sf = seqioOpen(&openOptions);
+  seqioRecord* record = NULL;
+  if (argc > 2) {
+    // writing views with a base case must fold a copy, not the mapping
+    seqioOpenOptions outOptions = {
+      .filename = NULL,
+      .mode = seqOpenModeWrite,
+    };
+    seqioFile* out = seqioOpen(&outOptions);
+    seqioWriteOptions writeOptions = {
+      .lineWidth = 0,
+      .includeComment = true,
+      .baseCase = strcmp(argv[2], "upper") == 0 ? seqioBaseCaseUpper
+                                                : seqioBaseCaseLower,
+    };
+    while ((record = seqioRead(sf, record)) != NULL) {
+      if (record->type == seqioRecordTypeFastq) {
+        seqioWriteFastq(out, record, &writeOptions);
+      } else {
+        seqioWriteFasta(out, record, &writeOptions);
+      }
+    }
+    seqioClose(out);
+    seqioClose(sf);
+    return 0;
+  }
+  // fields are views into the mapped file and are not NUL-terminated
+  while ((record = seqioRead(sf, record)) != NULL) {
+    printf("name: %.*s: length: %zu\n", (int)record->name->length,
+           record->name->data, record->sequence->length);
+  }
+  seqioClose(sf);
+}